@@ -0,0 +1,208 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+
+#include "main.h"
+#include "options.h"
+#include "openvpn.h"
+#include "scripts.h"
+#include "tray.h"
+#include "localization.h"
+#include "openvpn-gui-res.h"
+#include "conn_state.h"
+#include "resume.h"
+#include "autostart.h"
+
+extern options_t o;
+
+/*
+ * Connections started at program start. Pre-connect scripts are run by
+ * a pool of at most autostart_concurrency worker threads, which then
+ * have the main window launch OpenVPN, so that slow scripts neither
+ * block the UI thread nor each other.
+ */
+static struct {
+    connection_t *conn[MAX_CONFIGS];
+    LONG count;
+    volatile LONG next;             /* index of the next connection to prepare */
+    volatile LONG pending;          /* # of connections not connected or failed yet */
+    volatile LONG connected;        /* # of connections that connected */
+    volatile LONG waiting[MAX_CONFIGS];  /* connection is counted in pending */
+    volatile LONG cancel;
+    ULONGLONG start;                /* tick when auto-start began */
+} autostart;
+
+static DWORD WINAPI
+AutoStartWorker(UNUSED void *p)
+{
+    LONG i;
+
+    while (!autostart.cancel && (i = InterlockedIncrement(&autostart.next) - 1) < autostart.count)
+    {
+        connection_t *c = autostart.conn[i];
+
+        RunPreconnectScript(c);
+        if (!PostMessage(o.hWnd, WM_AUTOSTART, 0, (LPARAM) c))
+            AutoStartSettled(c, FALSE);
+    }
+    return 0;
+}
+
+/*
+ * Run the pre-connect script of a single connection, see PrepareConnection
+ */
+static DWORD WINAPI
+PrepareWorker(void *p)
+{
+    connection_t *c = p;
+
+    RunPreconnectScript(c);
+    if (!PostMessage(o.hWnd, WM_AUTOSTART, 0, (LPARAM) c))
+        ResumeSettled(c, FALSE);
+    return 0;
+}
+
+/*
+ * Run the pre-connect script of a connection marked busy with ev_prepare
+ * on a thread of its own, then have the main window launch OpenVPN as
+ * for auto-started connections. The script runs on the calling thread if
+ * no thread can be started.
+ */
+void
+PrepareConnection(connection_t *c)
+{
+    HANDLE thread = CreateThread(NULL, 0, PrepareWorker, c, 0, NULL);
+
+    if (thread)
+        CloseHandle(thread);
+    else
+        PrepareWorker(c);
+}
+
+/*
+ * Start the connections concurrently, as limited by autostart_concurrency.
+ * With autostart_concurrency 0 they are started one after the other on
+ * the calling thread.
+ */
+void
+StartAutoConnections(connection_t **conn, int count)
+{
+    DWORD workers;
+    HANDLE thread;
+    int i;
+
+    CLEAR(autostart);
+    if (count <= 0)
+        return;
+
+    /* Connections already started are left alone, the others are busy
+     * from now on so that the menu does not offer to connect them */
+    for (i = 0; i < count && autostart.count < MAX_CONFIGS; i++)
+    {
+        if (conn[i]->hwndStatus || !ConnStateEvent(conn[i], ev_prepare, NULL))
+            continue;
+        autostart.conn[autostart.count++] = conn[i];
+        autostart.waiting[conn[i] - o.conn] = 1;
+    }
+    if (autostart.count == 0)
+        return;
+    autostart.pending = autostart.count;
+    autostart.start = GetTickCount64();
+
+    workers = min(o.autostart_concurrency, (DWORD) autostart.count);
+    for (i = 0; i < (int) workers; i++)
+    {
+        thread = CreateThread(NULL, 0, AutoStartWorker, NULL, 0, NULL);
+        if (thread == NULL)
+            break;
+        CloseHandle(thread);
+    }
+
+    /* No worker could be started, or none wanted */
+    if (i == 0)
+        AutoStartWorker(NULL);
+}
+
+/*
+ * Handle WM_AUTOSTART: launch a connection whose pre-connect script has
+ * run, either auto-started or restarted on resume
+ */
+void
+OnAutoStart(connection_t *c)
+{
+    /* Started by other means in the meantime */
+    if (c->hwndStatus)
+        return;
+
+    if (autostart.cancel || !LaunchOpenVPN(c))
+    {
+        /* Not busy any more */
+        if (!c->hwndStatus)
+            ConnStateEvent(c, ev_exit, NULL);
+        AutoStartSettled(c, FALSE);
+        ResumeSettled(c, FALSE);
+    }
+}
+
+/*
+ * Count an auto-started connection as connected or failed. Once all have
+ * settled, report how long it took to get them connected.
+ */
+void
+AutoStartSettled(connection_t *c, BOOL connected)
+{
+    WCHAR title[256], msg[256];
+    LONG n = c - o.conn;
+    DWORD ms;
+
+    if (n < 0 || n >= MAX_CONFIGS || InterlockedExchange(&autostart.waiting[n], 0) == 0)
+        return;
+
+    if (connected)
+        InterlockedIncrement(&autostart.connected);
+    if (InterlockedDecrement(&autostart.pending) != 0)
+        return;
+
+    ms = (DWORD) (GetTickCount64() - autostart.start);
+    PrintDebug(L"Auto-start: %ld of %ld connections connected in %lu ms",
+               autostart.connected, autostart.count, ms);
+
+    if (autostart.count > 1 && o.show_balloon != 0 && !autostart.cancel)
+    {
+        LoadLocalizedStringBuf(title, _countof(title), IDS_NFO_AUTOSTART_DONE_TITLE);
+        LoadLocalizedStringBuf(msg, _countof(msg), IDS_NFO_AUTOSTART_DONE,
+                               autostart.connected, autostart.count, ms / 1000.0);
+        ShowTrayBalloon(title, msg);
+    }
+}
+
+/*
+ * Do not launch any more connections, e.g. as the program is exiting
+ */
+void
+CancelAutoStart(void)
+{
+    InterlockedExchange(&autostart.cancel, 1);
+}
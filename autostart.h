@@ -0,0 +1,37 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef AUTOSTART_H
+#define AUTOSTART_H
+
+#include <windows.h>
+
+#include "options.h"
+
+/* Posted to the main window when a connection is ready to be launched */
+#define WM_AUTOSTART (WM_APP + 30)
+
+void StartAutoConnections(connection_t **conn, int count);
+void PrepareConnection(connection_t *c);
+void OnAutoStart(connection_t *c);
+void AutoStartSettled(connection_t *c, BOOL connected);
+void CancelAutoStart(void);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+/*
+ * Benchmark of the per-line cost of formatting log timestamps: a burst
+ * of lines, a given number per second, each formatted by _wctime() and
+ * copied as WriteStatusLog and the status window used to do, and then by
+ * LogTimeString().
+ *
+ *   bench-logtime [lines] [lines per second]
+ *
+ * The defaults are 1000000 lines and 100 lines per second.
+ */
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <time.h>
+
+#include "log_time.h"
+
+static double
+Seconds(LARGE_INTEGER t0, LARGE_INTEGER t1)
+{
+    LARGE_INTEGER freq;
+
+    QueryPerformanceFrequency(&freq);
+    return (double) (t1.QuadPart - t0.QuadPart) / freq.QuadPart;
+}
+
+int
+main(int argc, char *argv[])
+{
+    long lines = (argc > 1) ? atol(argv[1]) : 1000000;
+    long per_second = (argc > 2) ? atol(argv[2]) : 100;
+    time_t start = time(NULL);
+    LARGE_INTEGER t0, t1;
+    double before, after;
+    WCHAR buf[32];
+    size_t sum = 0;
+    long i;
+
+    if (lines <= 0 || per_second <= 0)
+    {
+        fprintf(stderr, "Usage: bench-logtime [lines] [lines per second]\n");
+        return 1;
+    }
+
+    /* Both must give the same text */
+    for (i = 0; i < per_second * 3; i++)
+    {
+        time_t t = start + i / per_second;
+        const WCHAR *s = _wctime(&t);
+
+        wcsncpy(buf, (s ? s : L""), 24);
+        buf[24] = L'\0';
+        if (wcscmp(buf, LogTimeString(t)) != 0)
+        {
+            fprintf(stderr, "LogTimeString differs from _wctime at %ld\n", i);
+            return 1;
+        }
+    }
+
+    QueryPerformanceCounter(&t0);
+    for (i = 0; i < lines; i++)
+    {
+        time_t t = start + i / per_second;
+        const WCHAR *s = _wctime(&t);
+
+        wcsncpy(buf, (s ? s : L""), 24);
+        buf[24] = L'\0';
+        sum += buf[i % 24];
+    }
+    QueryPerformanceCounter(&t1);
+    before = Seconds(t0, t1);
+
+    QueryPerformanceCounter(&t0);
+    for (i = 0; i < lines; i++)
+    {
+        time_t t = start + i / per_second;
+
+        sum += LogTimeString(t)[i % 24];
+    }
+    QueryPerformanceCounter(&t1);
+    after = Seconds(t0, t1);
+
+    printf("%ld lines, %ld per second\n", lines, per_second);
+    printf("_wctime:       %8.1f ns/line\n", before * 1e9 / lines);
+    printf("LogTimeString: %8.1f ns/line (%.1fx)\n", after * 1e9 / lines,
+           after > 0 ? before / after : 0.0);
+
+    /* Keep the loops from being optimized away */
+    return (sum == 0) ? 2 : 0;
+}
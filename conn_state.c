@@ -0,0 +1,318 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+
+#include "main.h"
+#include "options.h"
+#include "tray.h"
+#include "conn_state.h"
+
+/* Side effects of a transition */
+#define ACT_TRAY    (1<<0)  /* update the tray icon */
+#define ACT_MENU    (1<<1)  /* update the menu of the connection */
+#define ACT_RESET   (1<<2)  /* reset the failed password and auth attempts */
+
+typedef struct {
+    BYTE to;                /* new state, conn_state_max if the event is ignored */
+    BYTE actions;           /* ACT_* */
+} conn_transition_rule_t;
+
+#define T(to, actions) { to, actions }
+#define IGNORE { conn_state_max, 0 }
+
+/*
+ * Transitions by current state and event. Events that make no sense in
+ * a state, like a late CONNECTED while disconnecting, are ignored.
+ * ev_prepare marks a connection busy while its pre-connect script runs
+ * on a worker, the ev_start of its status window then keeps the state.
+ */
+static const conn_transition_rule_t transitions[conn_state_max][conn_event_max] = {
+    [disconnected] = {
+        [ev_start]        = T(connecting, ACT_TRAY|ACT_MENU),
+        [ev_prepare]      = T(connecting, ACT_TRAY|ACT_MENU),
+        [ev_connected]    = IGNORE,
+        [ev_reconnecting] = IGNORE,
+        [ev_restart]      = IGNORE,
+        [ev_stop]         = IGNORE,
+        [ev_suspend]      = IGNORE,
+        [ev_timeout]      = IGNORE,
+        [ev_exit]         = T(disconnected, ACT_MENU),
+    },
+    [connecting] = {
+        [ev_start]        = T(connecting, ACT_TRAY|ACT_MENU),
+        [ev_prepare]      = IGNORE,
+        [ev_connected]    = T(connected, ACT_TRAY|ACT_MENU|ACT_RESET),
+        [ev_reconnecting] = T(reconnecting, ACT_TRAY),
+        [ev_restart]      = T(reconnecting, 0),
+        [ev_stop]         = T(disconnecting, ACT_MENU),
+        [ev_suspend]      = T(suspending, ACT_MENU),
+        [ev_timeout]      = T(timedout, 0),
+        [ev_exit]         = T(disconnected, ACT_TRAY|ACT_MENU),
+    },
+    [reconnecting] = {
+        [ev_start]        = T(connecting, ACT_TRAY|ACT_MENU),
+        [ev_prepare]      = IGNORE,
+        [ev_connected]    = T(connected, ACT_TRAY|ACT_MENU|ACT_RESET),
+        [ev_reconnecting] = T(reconnecting, ACT_TRAY),
+        [ev_restart]      = T(reconnecting, 0),
+        [ev_stop]         = T(disconnecting, ACT_MENU),
+        [ev_suspend]      = T(suspending, ACT_MENU),
+        [ev_timeout]      = T(timedout, 0),
+        [ev_exit]         = T(disconnected, ACT_TRAY|ACT_MENU),
+    },
+    [connected] = {
+        [ev_start]        = T(connecting, ACT_TRAY|ACT_MENU),
+        [ev_prepare]      = IGNORE,
+        [ev_connected]    = T(connected, ACT_TRAY|ACT_MENU|ACT_RESET),
+        [ev_reconnecting] = T(reconnecting, ACT_TRAY),
+        [ev_restart]      = T(reconnecting, 0),
+        [ev_stop]         = T(disconnecting, ACT_MENU),
+        [ev_suspend]      = T(suspending, ACT_MENU),
+        [ev_timeout]      = T(timedout, 0),
+        [ev_exit]         = T(disconnected, ACT_TRAY|ACT_MENU|ACT_RESET),
+    },
+    [disconnecting] = {
+        [ev_start]        = T(connecting, ACT_TRAY|ACT_MENU),
+        [ev_prepare]      = IGNORE,
+        [ev_connected]    = IGNORE,
+        [ev_reconnecting] = IGNORE,
+        [ev_restart]      = IGNORE,
+        [ev_stop]         = T(disconnecting, ACT_MENU),
+        [ev_suspend]      = IGNORE,
+        [ev_timeout]      = IGNORE,
+        [ev_exit]         = T(disconnected, ACT_TRAY|ACT_MENU|ACT_RESET),
+    },
+    [suspending] = {
+        [ev_start]        = T(connecting, ACT_TRAY|ACT_MENU),
+        [ev_prepare]      = IGNORE,
+        [ev_connected]    = IGNORE,
+        [ev_reconnecting] = IGNORE,
+        [ev_restart]      = IGNORE,
+        [ev_stop]         = T(disconnecting, ACT_MENU),
+        [ev_suspend]      = T(suspending, ACT_MENU),
+        [ev_timeout]      = IGNORE,
+        [ev_exit]         = T(suspended, ACT_TRAY|ACT_MENU),
+    },
+    [suspended] = {
+        [ev_start]        = T(resuming, ACT_TRAY|ACT_MENU),
+        [ev_prepare]      = T(resuming, ACT_TRAY|ACT_MENU),
+        [ev_connected]    = IGNORE,
+        [ev_reconnecting] = IGNORE,
+        [ev_restart]      = IGNORE,
+        [ev_stop]         = T(disconnecting, ACT_MENU),
+        [ev_suspend]      = IGNORE,
+        [ev_timeout]      = IGNORE,
+        [ev_exit]         = T(suspended, ACT_MENU),
+    },
+    [resuming] = {
+        [ev_start]        = T(resuming, ACT_TRAY|ACT_MENU),
+        [ev_prepare]      = IGNORE,
+        [ev_connected]    = T(connected, ACT_TRAY|ACT_MENU|ACT_RESET),
+        [ev_reconnecting] = T(reconnecting, ACT_TRAY),
+        [ev_restart]      = T(reconnecting, 0),
+        [ev_stop]         = T(disconnecting, ACT_MENU),
+        [ev_suspend]      = T(suspending, ACT_MENU),
+        [ev_timeout]      = T(timedout, 0),
+        [ev_exit]         = T(disconnected, ACT_TRAY|ACT_MENU),
+    },
+    [timedout] = {
+        [ev_start]        = T(connecting, ACT_TRAY|ACT_MENU),
+        [ev_prepare]      = IGNORE,
+        [ev_connected]    = T(connected, ACT_TRAY|ACT_MENU|ACT_RESET),
+        [ev_reconnecting] = T(reconnecting, ACT_TRAY),
+        [ev_restart]      = IGNORE,
+        [ev_stop]         = T(disconnecting, ACT_MENU),
+        [ev_suspend]      = T(suspending, ACT_MENU),
+        [ev_timeout]      = T(timedout, 0),
+        [ev_exit]         = T(disconnected, ACT_TRAY|ACT_MENU),
+    },
+};
+
+static const WCHAR *state_names[conn_state_max] = {
+    L"disconnected", L"connecting", L"reconnecting", L"connected", L"disconnecting",
+    L"suspending", L"suspended", L"resuming", L"timedout"
+};
+
+static const WCHAR *event_names[conn_event_max] = {
+    L"start", L"prepare", L"connected", L"reconnecting", L"restart", L"stop", L"suspend",
+    L"timeout", L"exit"
+};
+
+const WCHAR *
+ConnStateName(conn_state_t state)
+{
+    return (state < conn_state_max) ? state_names[state] : L"?";
+}
+
+const WCHAR *
+ConnEventName(conn_event_t ev)
+{
+    return (ev < conn_event_max) ? event_names[ev] : L"?";
+}
+
+/*
+ * State the menu of a connection is shown for
+ */
+static conn_state_t
+MenuState(conn_state_t state)
+{
+    switch (state)
+    {
+    case suspending:
+        return disconnecting;
+    case suspended:
+        return disconnected;
+    case resuming:
+        return connecting;
+    default:
+        return state;
+    }
+}
+
+/*
+ * Change the state of a connection as the transition table says for
+ * this event and record the transition. The previous state is returned
+ * in prev if not NULL. Returns FALSE if the event is ignored in the
+ * current state, the caller then skips its own handling of the event.
+ */
+BOOL
+ConnStateEvent(connection_t *c, conn_event_t ev, conn_state_t *prev)
+{
+    conn_state_t from = c->state;
+    conn_trace_t *t = &c->trace;
+    const conn_transition_rule_t *rule;
+    conn_transition_t *tr;
+    ULONGLONG now, spent = 0;
+
+    if (prev)
+        *prev = from;
+    if (from >= conn_state_max || ev >= conn_event_max)
+        return FALSE;
+
+    rule = &transitions[from][ev];
+    if (rule->to == conn_state_max)
+    {
+        PrintDebug(L"%s: %s ignored while %s", c->config_name, ConnEventName(ev), ConnStateName(from));
+        return FALSE;
+    }
+
+    now = GetTickCount64();
+    AcquireSRWLockExclusive(&t->lock);
+    if (t->since)
+    {
+        spent = now - t->since;
+        t->time_in[from] += spent;
+    }
+    t->since = now;
+    tr = &t->ring[t->count++ % CONN_TRACE_SIZE];
+    tr->tick = now;
+    tr->from = (BYTE) from;
+    tr->to = rule->to;
+    tr->event = (BYTE) ev;
+    c->state = rule->to;
+    ReleaseSRWLockExclusive(&t->lock);
+
+    PrintDebug(L"%s: %s -> %s on %s after %I64u ms", c->config_name, ConnStateName(from),
+               ConnStateName(c->state), ConnEventName(ev), spent);
+
+    if (rule->actions & ACT_RESET)
+    {
+        c->failed_psw_attempts = 0;
+        c->failed_auth_attempts = 0;
+    }
+    if (rule->actions & ACT_MENU)
+        SetMenuStatus(c, MenuState(c->state));
+    if (rule->actions & ACT_TRAY)
+        CheckAndSetTrayIcon();
+
+    return TRUE;
+}
+
+/*
+ * Total time in milliseconds the connection has spent in a state,
+ * including the time in the current state
+ */
+ULONGLONG
+ConnStateTime(connection_t *c, conn_state_t state)
+{
+    conn_trace_t *t = &c->trace;
+    ULONGLONG ms;
+
+    if (state >= conn_state_max)
+        return 0;
+
+    AcquireSRWLockShared(&t->lock);
+    ms = t->time_in[state];
+    if (c->state == state && t->since)
+        ms += GetTickCount64() - t->since;
+    ReleaseSRWLockShared(&t->lock);
+    return ms;
+}
+
+/*
+ * Copy up to size of the most recent transitions, oldest first, to out.
+ * Returns the number of transitions copied.
+ */
+unsigned int
+ConnStateTrace(connection_t *c, conn_transition_t *out, unsigned int size)
+{
+    conn_trace_t *t = &c->trace;
+    unsigned int i, n, first;
+
+    AcquireSRWLockShared(&t->lock);
+    n = min(min(t->count, (unsigned int) CONN_TRACE_SIZE), size);
+    first = t->count - n;
+    for (i = 0; i < n; i++)
+        out[i] = t->ring[(first + i) % CONN_TRACE_SIZE];
+    ReleaseSRWLockShared(&t->lock);
+    return n;
+}
+
+/*
+ * Print the time spent in each state and the recent transitions of a
+ * connection to the debug log
+ */
+void
+PrintConnStateTrace(UNUSED connection_t *c)
+{
+#ifdef DEBUG
+    conn_transition_t trace[CONN_TRACE_SIZE];
+    unsigned int i, n;
+    int s;
+
+    for (s = 0; s < conn_state_max; s++)
+    {
+        ULONGLONG ms = ConnStateTime(c, s);
+        if (ms)
+            PrintDebug(L"%s: %I64u ms %s", c->config_name, ms, ConnStateName(s));
+    }
+
+    n = ConnStateTrace(c, trace, _countof(trace));
+    for (i = 0; i < n; i++)
+        PrintDebug(L"%s: @%I64u %s -> %s on %s", c->config_name, trace[i].tick,
+                   ConnStateName(trace[i].from), ConnStateName(trace[i].to),
+                   ConnEventName(trace[i].event));
+#endif
+}
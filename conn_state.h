@@ -0,0 +1,84 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef CONN_STATE_H
+#define CONN_STATE_H
+
+#include <windows.h>
+#include <time.h>
+
+/* connection states */
+typedef enum {
+    disconnected,
+    connecting,
+    reconnecting,
+    connected,
+    disconnecting,
+    suspending,
+    suspended,
+    resuming,
+    timedout,
+    conn_state_max
+} conn_state_t;
+
+/* Events changing the state of a connection */
+typedef enum {
+    ev_start,           /* status window opened to (re)start openvpn */
+    ev_prepare,         /* pre-connect script run ahead of the start */
+    ev_connected,       /* OpenVPN reported CONNECTED,SUCCESS */
+    ev_reconnecting,    /* OpenVPN reported RECONNECTING */
+    ev_restart,         /* user asked for a restart */
+    ev_stop,            /* user or GUI asked openvpn to exit */
+    ev_suspend,         /* openvpn asked to exit for suspend */
+    ev_timeout,         /* management interface or startup failed */
+    ev_exit,            /* openvpn exited or the management interface closed */
+    conn_event_max
+} conn_event_t;
+
+/* Transitions kept per connection */
+#define CONN_TRACE_SIZE 32
+
+typedef struct {
+    ULONGLONG tick;     /* GetTickCount64() at the transition */
+    BYTE from;          /* conn_state_t */
+    BYTE to;
+    BYTE event;         /* conn_event_t */
+} conn_transition_t;
+
+/*
+ * Ring of the most recent state transitions of a connection and the
+ * total time spent in each state
+ */
+typedef struct {
+    SRWLOCK lock;
+    conn_transition_t ring[CONN_TRACE_SIZE];
+    unsigned int count;             /* # of transitions ever recorded */
+    ULONGLONG since;                /* tick when the current state was entered */
+    ULONGLONG time_in[conn_state_max];  /* ms spent in each state before the current one */
+} conn_trace_t;
+
+BOOL ConnStateEvent(connection_t *c, conn_event_t ev, conn_state_t *prev);
+ULONGLONG ConnStateTime(connection_t *c, conn_state_t state);
+unsigned int ConnStateTrace(connection_t *c, conn_transition_t *out, unsigned int size);
+void PrintConnStateTrace(connection_t *c);
+const WCHAR *ConnStateName(conn_state_t state);
+const WCHAR *ConnEventName(conn_event_t ev);
+
+#endif
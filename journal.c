@@ -0,0 +1,444 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "main.h"
+#include "log_model.h"
+#include "log_writer.h"
+#include "journal.h"
+
+#define JOURNAL_MAGIC "OVPNJRN1"
+#define JOURNAL_MAGIC_SIZE 8
+#define JOURNAL_HEADER_SIZE 12
+#define JOURNAL_MAX_MSG (3 * MAX_LOG_LENGTH)
+
+/* Max # of bytes read from the end of the journal to restore records */
+#define JOURNAL_MAX_READ (64 * 1024 * 1024)
+
+typedef struct {
+    ULONGLONG record;
+    ULONGLONG offset;
+} journal_index_t;
+
+static BOOL
+JournalPath(WCHAR *path, size_t size, const WCHAR *log_path, const WCHAR *ext)
+{
+    WCHAR *p;
+
+    if (wcslen(log_path) >= size)
+        return FALSE;
+    wcscpy(path, log_path);
+    p = wcsrchr(path, L'.');
+    if (p == NULL || (size_t) (p - path) + wcslen(ext) >= size)
+        return FALSE;
+    wcscpy(p, ext);
+    return TRUE;
+}
+
+static void
+PutRecordHeader(char *buf, time_t timestamp, WORD flags, WORD len)
+{
+    ULONGLONG t = (ULONGLONG) (LONGLONG) timestamp;
+    int i;
+
+    for (i = 0; i < 8; ++i)
+        buf[i] = (char) (t >> (8 * i));
+    buf[8] = (char) flags;
+    buf[9] = (char) (flags >> 8);
+    buf[10] = (char) len;
+    buf[11] = (char) (len >> 8);
+}
+
+/*
+ * Parse the record at buf. Returns its total size or 0 if it is
+ * incomplete or not a valid record.
+ */
+static size_t
+GetRecord(const unsigned char *buf, size_t size, time_t *timestamp, WORD *flags, const char **msg, WORD *len)
+{
+    ULONGLONG t = 0;
+    int i;
+
+    if (size < JOURNAL_HEADER_SIZE)
+        return 0;
+    for (i = 7; i >= 0; --i)
+        t = (t << 8) | buf[i];
+    *timestamp = (time_t) (LONGLONG) t;
+    *flags = buf[8] | (buf[9] << 8);
+    *len = buf[10] | (buf[11] << 8);
+    if (*len > JOURNAL_MAX_MSG || (*flags & ~0x3F) || JOURNAL_HEADER_SIZE + (size_t) *len > size)
+        return 0;
+    *msg = (const char *) buf + JOURNAL_HEADER_SIZE;
+    return JOURNAL_HEADER_SIZE + *len;
+}
+
+/*
+ * Read the entries of the index. Returns NULL if there are none.
+ */
+static journal_index_t *
+ReadIndex(const WCHAR *path, DWORD *count)
+{
+    journal_index_t *entries = NULL;
+    LARGE_INTEGER size;
+    DWORD read;
+    HANDLE h;
+
+    *count = 0;
+    h = CreateFile(path, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                   NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if (GetFileSizeEx(h, &size) && size.QuadPart <= 16 * 1024 * 1024
+        && (*count = (DWORD) (size.QuadPart / sizeof(*entries))) != 0
+        && (entries = malloc(*count * sizeof(*entries))) != NULL
+        && (!ReadFile(h, entries, *count * sizeof(*entries), &read, NULL)
+            || read != *count * sizeof(*entries)))
+    {
+        free(entries);
+        entries = NULL;
+    }
+    if (entries == NULL)
+        *count = 0;
+    CloseHandle(h);
+    return entries;
+}
+
+/*
+ * Find where to start reading to get the last restore records: the last
+ * indexed record at least restore records before the end. The index was
+ * last written up to JOURNAL_INDEX_INTERVAL records before the end.
+ * Falls back to the first record if the index is missing or wrong.
+ */
+static journal_index_t
+FindIndex(const WCHAR *path, unsigned int restore, ULONGLONG journal_size)
+{
+    journal_index_t ret = { 0, JOURNAL_MAGIC_SIZE };
+    journal_index_t *entries;
+    DWORD count, lo, hi;
+    ULONGLONG end, n;
+
+    entries = ReadIndex(path, &count);
+    if (entries == NULL)
+        return ret;
+
+    end = entries[count - 1].record + JOURNAL_INDEX_INTERVAL;
+    n = (end > restore ? end - restore : 0);
+
+    /* Last entry for a record at or before n */
+    lo = 0;
+    hi = count;
+    while (lo < hi)
+    {
+        DWORD mid = lo + (hi - lo) / 2;
+        if (entries[mid].record <= n)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0 && entries[lo - 1].offset >= JOURNAL_MAGIC_SIZE && entries[lo - 1].offset < journal_size)
+        ret = entries[lo - 1];
+
+    free(entries);
+    return ret;
+}
+
+/*
+ * Write the index of a journal whose records from start on are at data,
+ * as validated by RestoreJournal: entries of the old index up to start
+ * are kept, those of the records at data are taken from data.
+ */
+static void
+RebuildIndex(const WCHAR *index_path, journal_index_t start, const unsigned char *data, size_t size)
+{
+    journal_index_t *entries, e;
+    DWORD count, i, written;
+    const char *msg;
+    time_t t;
+    WORD flags, len;
+    size_t pos;
+    ULONGLONG n;
+    HANDLE hi;
+
+    entries = ReadIndex(index_path, &count);
+    hi = CreateFile(index_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hi == INVALID_HANDLE_VALUE)
+    {
+        /* An index pointing past the end is worse than none */
+        DeleteFile(index_path);
+        free(entries);
+        return;
+    }
+
+    for (i = 0; i < count && entries[i].record < start.record && entries[i].offset < start.offset; ++i)
+        WriteFile(hi, &entries[i], sizeof(entries[i]), &written, NULL);
+
+    for (pos = 0, n = start.record; pos < size; pos += GetRecord(data + pos, size - pos, &t, &flags, &msg, &len), ++n)
+    {
+        if (n % JOURNAL_INDEX_INTERVAL == 0)
+        {
+            e.record = n;
+            e.offset = start.offset + pos;
+            WriteFile(hi, &e, sizeof(e), &written, NULL);
+        }
+    }
+    CloseHandle(hi);
+    free(entries);
+}
+
+/*
+ * Replace the journal by its last records at data and rebuild the index
+ */
+static BOOL
+CompactJournal(const WCHAR *path, const WCHAR *index_path, const unsigned char *data, size_t size,
+               ULONGLONG *count)
+{
+    WCHAR tmp[MAX_PATH];
+    HANDLE h, hi;
+    DWORD written;
+    journal_index_t e;
+    const char *msg;
+    time_t t;
+    WORD flags, len;
+    size_t pos, n;
+    BOOL ok;
+
+    if (!JournalPath(tmp, _countof(tmp), path, L".journal-new"))
+        return FALSE;
+    h = CreateFile(tmp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+        return FALSE;
+    ok = WriteFile(h, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE, &written, NULL)
+         && WriteFile(h, data, (DWORD) size, &written, NULL) && written == size;
+    CloseHandle(h);
+    if (!ok || !MoveFileEx(tmp, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(tmp);
+        return FALSE;
+    }
+
+    hi = CreateFile(index_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    for (pos = 0, n = 0; pos < size; pos += GetRecord(data + pos, size - pos, &t, &flags, &msg, &len), ++n)
+    {
+        if (n % JOURNAL_INDEX_INTERVAL == 0 && hi != INVALID_HANDLE_VALUE)
+        {
+            e.record = n;
+            e.offset = JOURNAL_MAGIC_SIZE + pos;
+            WriteFile(hi, &e, sizeof(e), &written, NULL);
+        }
+    }
+    if (hi != INVALID_HANDLE_VALUE)
+        CloseHandle(hi);
+
+    *count = n;
+    return TRUE;
+}
+
+/*
+ * Read the records of the journal from the indexed record before the
+ * last restore ones, add up to restore of them to the log model and set
+ * the size and # of records of the journal. A damaged tail is cut off.
+ */
+static void
+RestoreJournal(journal_t *j, const WCHAR *path, const WCHAR *index_path, log_model_t *m, unsigned int restore)
+{
+    unsigned char *data = NULL;
+    LARGE_INTEGER size, pos;
+    journal_index_t start;
+    char magic[JOURNAL_MAGIC_SIZE];
+    WCHAR wmsg[MAX_LOG_LENGTH + 1];
+    ULONGLONG records = 0, skip;
+    size_t len, used, keep_from = 0;
+    DWORD read;
+    const char *msg;
+    time_t t;
+    WORD flags, mlen;
+    int nch;
+    HANDLE h;
+
+    j->size = 0;
+    j->count = 0;
+
+    h = CreateFile(path, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_DELETE,
+                   NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+
+    if (!GetFileSizeEx(h, &size) || size.QuadPart < JOURNAL_MAGIC_SIZE
+        || !ReadFile(h, magic, sizeof(magic), &read, NULL) || read != sizeof(magic)
+        || memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0)
+    {
+        /* Not a journal, start over */
+        SetFilePointer(h, 0, NULL, FILE_BEGIN);
+        SetEndOfFile(h);
+        goto out;
+    }
+
+    start = FindIndex(index_path, restore, size.QuadPart);
+    if (size.QuadPart - start.offset > JOURNAL_MAX_READ)
+    {
+        /* Too much to read without a usable index, start over */
+        PrintDebug(L"Journal %s: no usable index, starting a new journal", path);
+        SetFilePointer(h, 0, NULL, FILE_BEGIN);
+        SetEndOfFile(h);
+        goto out;
+    }
+
+    len = (size_t) (size.QuadPart - start.offset);
+    data = malloc(len ? len : 1);
+    pos.QuadPart = start.offset;
+    if (data == NULL || !SetFilePointerEx(h, pos, NULL, FILE_BEGIN)
+        || !ReadFile(h, data, (DWORD) len, &read, NULL))
+        goto out;
+    len = read;
+
+    /* Count the valid records, then skip all but the last restore ones */
+    for (used = 0; used < len; used += GetRecord(data + used, len - used, &t, &flags, &msg, &mlen), ++records)
+    {
+        if (GetRecord(data + used, len - used, &t, &flags, &msg, &mlen) == 0)
+            break;
+    }
+    if (start.offset + used < (ULONGLONG) size.QuadPart)
+    {
+        PrintDebug(L"Journal %s: cutting %I64u damaged bytes", path, size.QuadPart - start.offset - used);
+        pos.QuadPart = start.offset + used;
+        SetFilePointerEx(h, pos, NULL, FILE_BEGIN);
+        SetEndOfFile(h);
+
+        /* The index may point past the end now */
+        RebuildIndex(index_path, start, data, used);
+    }
+    j->size = start.offset + used;
+    j->count = start.record + records;
+
+    for (skip = (records > restore ? records - restore : 0); skip; --skip)
+        keep_from += GetRecord(data + keep_from, used - keep_from, &t, &flags, &msg, &mlen);
+
+    for (len = keep_from; len < used; )
+    {
+        len += GetRecord(data + len, used - len, &t, &flags, &msg, &mlen);
+        nch = MultiByteToWideChar(CP_UTF8, 0, msg, mlen, wmsg, _countof(wmsg) - 1);
+        wmsg[nch] = L'\0';
+        LogModelAdd(m, t, flags, L"", wmsg);
+    }
+
+    if (j->size > JOURNAL_MAX_SIZE)
+    {
+        CloseHandle(h);
+        h = INVALID_HANDLE_VALUE;
+        if (CompactJournal(path, index_path, data + keep_from, used - keep_from, &j->count))
+            j->size = JOURNAL_MAGIC_SIZE + used - keep_from;
+        else
+            PrintDebug(L"Journal %s: compacting failed", path);
+    }
+
+out:
+    if (h != INVALID_HANDLE_VALUE)
+        CloseHandle(h);
+    free(data);
+}
+
+/*
+ * Restore up to restore records of the journal of a log file to the log
+ * model and open the journal for appending
+ */
+BOOL
+OpenJournal(journal_t *j, const WCHAR *log_path, log_model_t *m, unsigned int restore)
+{
+    WCHAR path[MAX_PATH], index_path[MAX_PATH];
+
+    CLEAR(*j);
+    if (!JournalPath(path, _countof(path), log_path, L".journal")
+        || !JournalPath(index_path, _countof(index_path), log_path, L".journal.idx"))
+        return FALSE;
+
+    /* The journal of the previous session may still be in the writer queue */
+    if (!WaitLogFileClosed(path, 2000) || !WaitLogFileClosed(index_path, 2000))
+        PrintDebug(L"Journal %s: still being written, history may be incomplete", path);
+
+    RestoreJournal(j, path, index_path, m, restore);
+
+    j->file = OpenLogFile(path, 0);
+    j->index = OpenLogFile(index_path, 0);
+    if (j->file == NULL || j->index == NULL)
+    {
+        CloseJournal(j);
+        return FALSE;
+    }
+
+    if (j->size == 0)
+    {
+        /* New journal, also drop an index left over from an old one */
+        DeleteFile(index_path);
+        if (WriteLogFile(j->file, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE))
+            j->size = JOURNAL_MAGIC_SIZE;
+    }
+    return TRUE;
+}
+
+/*
+ * Queue a record with the message prefix followed by msg
+ */
+void
+WriteJournal(journal_t *j, time_t timestamp, WORD flags, const WCHAR *prefix, const WCHAR *msg)
+{
+    char buf[JOURNAL_HEADER_SIZE + JOURNAL_MAX_MSG];
+    WCHAR line[MAX_LOG_LENGTH];
+    journal_index_t e;
+    int len;
+
+    if (j->file == NULL || j->size == 0)
+        return;
+
+    _snwprintf(line, _countof(line), L"%s%s", prefix, msg);
+    line[_countof(line) - 1] = L'\0';
+    len = WideCharToMultiByte(CP_UTF8, 0, line, -1, buf + JOURNAL_HEADER_SIZE, JOURNAL_MAX_MSG, NULL, NULL);
+    len = (len > 0) ? len - 1 : 0;
+    PutRecordHeader(buf, timestamp, flags, (WORD) len);
+
+    if (j->count % JOURNAL_INDEX_INTERVAL == 0)
+    {
+        e.record = j->count;
+        e.offset = j->size;
+        WriteLogFile(j->index, &e, sizeof(e));
+    }
+
+    /* Offsets in the index stay right only for records actually queued */
+    if (WriteLogFile(j->file, buf, JOURNAL_HEADER_SIZE + len))
+    {
+        j->size += JOURNAL_HEADER_SIZE + len;
+        j->count++;
+    }
+}
+
+void
+CloseJournal(journal_t *j)
+{
+    CloseLogFile(j->file);
+    CloseLogFile(j->index);
+    CLEAR(*j);
+}
@@ -0,0 +1,54 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <windows.h>
+#include <time.h>
+
+#include "log_model.h"
+#include "log_writer.h"
+
+/* Records between entries of the journal index */
+#define JOURNAL_INDEX_INTERVAL 256
+
+/* A journal larger than this is compacted when it is opened */
+#define JOURNAL_MAX_SIZE (16 * 1024 * 1024)
+
+/*
+ * Binary journal of the log records of a connection, <config>.journal
+ * in the log directory. It starts with JOURNAL_MAGIC followed by records
+ * of a 64 bit time, 16 bit flags and 16 bit length, all little endian,
+ * and the message in UTF-8. <config>.journal.idx lists the record number
+ * and file offset of every JOURNAL_INDEX_INTERVAL'th record, so that the
+ * most recent records can be read without reading the whole journal.
+ */
+typedef struct {
+    log_file_t *file;
+    log_file_t *index;
+    ULONGLONG size;         /* size of the journal including queued records */
+    ULONGLONG count;        /* # of records in the journal */
+} journal_t;
+
+BOOL OpenJournal(journal_t *j, const WCHAR *log_path, log_model_t *m, unsigned int restore);
+void WriteJournal(journal_t *j, time_t timestamp, WORD flags, const WCHAR *prefix, const WCHAR *msg);
+void CloseJournal(journal_t *j);
+
+#endif
@@ -0,0 +1,538 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "log_model.h"
+#include "log_index.h"
+#include "text_index.h"
+
+/* Bytes indexed before new lines are made available */
+#define INDEX_CHUNK (4 * 1024 * 1024)
+
+/* Milliseconds between checks for growth of the file */
+#define INDEX_POLL 500
+
+/* Lines added to the text index before checking for new lines */
+#define INDEX_TEXT_LINES 65536
+
+/* Max size of a mapped window of the file, has to exceed INDEX_CHUNK by
+ * the allocation granularity at least */
+#define LOG_WINDOW_SIZE (32 * 1024 * 1024)
+
+static DWORD granularity;
+
+/*
+ * Case insensitive search for an ASCII string in a line
+ */
+static BOOL
+FindNoCase(const char *line, size_t len, const char *str)
+{
+    size_t n = strlen(str);
+    size_t i;
+
+    for (i = 0; i + n <= len; ++i)
+    {
+        if (_strnicmp(line + i, str, n) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * The log file has no flags unless OpenVPN runs with
+ * --machine-readable-output, which puts a flag letter after the time.
+ * Otherwise make a guess from the message.
+ */
+BYTE
+LogIndexGuessFlags(const char *line, size_t len)
+{
+    size_t i, n = min(len, (size_t) 48);
+
+    for (i = 1; i + 2 < n; ++i)
+    {
+        if (line[i] != ' ' || line[i + 2] != ' ' || line[i - 1] < '0' || line[i - 1] > '9')
+            continue;
+        switch (line[i + 1])
+        {
+        case 'I': return LOG_FLAG_INFO;
+        case 'F': return LOG_FLAG_FATAL;
+        case 'N': return LOG_FLAG_NONFATAL;
+        case 'W': return LOG_FLAG_WARN;
+        case 'D': return LOG_FLAG_DEBUG;
+        }
+    }
+
+    if (FindNoCase(line, len, "fatal"))
+        return LOG_FLAG_FATAL;
+    if (FindNoCase(line, len, "error"))
+        return LOG_FLAG_NONFATAL;
+    if (FindNoCase(line, len, "warning"))
+        return LOG_FLAG_WARN;
+    return LOG_FLAG_INFO;
+}
+
+static void
+UnmapLogWindow(log_window_t *w)
+{
+    if (w->data)
+        UnmapViewOfFile(w->data);
+    CLEAR(*w);
+}
+
+/*
+ * Make sure window w covers the bytes from pos to end, mapping another
+ * part of the file if required. Returns a pointer to the byte at pos or
+ * NULL on error. Must be called with li->lock held or from the index
+ * thread, as it uses the current mapping.
+ */
+static const char *
+MapLogWindow(log_index_t *li, log_window_t *w, ULONGLONG pos, ULONGLONG end)
+{
+    ULONGLONG base;
+    const char *data;
+    size_t size;
+
+    if (w->data && pos >= w->base && end <= w->base + w->size)
+        return w->data + (pos - w->base);
+
+    base = pos - pos % granularity;
+    if (!li->mapping || end > li->size || end - base > LOG_WINDOW_SIZE)
+        return NULL;
+
+    size = (size_t) min(li->size - base, (ULONGLONG) LOG_WINDOW_SIZE);
+    data = MapViewOfFile(li->mapping, FILE_MAP_READ, (DWORD) (base >> 32), (DWORD) base, size);
+    if (data == NULL)
+    {
+        PrintDebug(L"Log index: cannot map %s at %I64u: error = %lu", li->path, base, GetLastError());
+        return NULL;
+    }
+
+    UnmapLogWindow(w);
+    w->data = data;
+    w->base = base;
+    w->size = size;
+    return data + (pos - base);
+}
+
+/*
+ * Map the current size of the file. Returns FALSE if the file did not
+ * change or could not be mapped.
+ */
+static BOOL
+RemapLogFile(log_index_t *li)
+{
+    LARGE_INTEGER size;
+    HANDLE mapping, old_mapping;
+    BOOL reset = FALSE;
+
+    if (!GetFileSizeEx(li->file, &size) || (ULONGLONG) size.QuadPart == li->size)
+        return FALSE;
+
+    /* Truncated, index again from the start */
+    if ((ULONGLONG) size.QuadPart < li->size)
+        reset = TRUE;
+
+    /* Windows mapped so far stay valid, they keep the old mapping alive */
+    mapping = NULL;
+    if (size.QuadPart > 0)
+    {
+        mapping = CreateFileMapping(li->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL)
+        {
+            PrintDebug(L"Log index: cannot map %s: error = %lu", li->path, GetLastError());
+            return FALSE;
+        }
+    }
+
+    AcquireSRWLockExclusive(&li->lock);
+    old_mapping = li->mapping;
+    li->mapping = mapping;
+    li->size = size.QuadPart;
+    if (reset)
+    {
+        li->count = 0;
+        li->scanned = 0;
+        li->text_lines = 0;
+        li->resets++;
+        TextIndexClear(&li->text);
+        AcquireSRWLockExclusive(&li->view_lock);
+        UnmapLogWindow(&li->view);
+        ReleaseSRWLockExclusive(&li->view_lock);
+    }
+    ReleaseSRWLockExclusive(&li->lock);
+
+    if (reset)
+        UnmapLogWindow(&li->scan);
+
+    if (old_mapping)
+        CloseHandle(old_mapping);
+    return TRUE;
+}
+
+/*
+ * Index the complete lines in up to INDEX_CHUNK bytes after the last
+ * indexed line. Returns the # of lines added.
+ */
+static size_t
+IndexChunk(log_index_t *li)
+{
+    ULONGLONG start = li->scanned, pos = start;
+    ULONGLONG end = min(li->size, pos + INDEX_CHUNK);
+    const char *data;
+    size_t added = 0;
+
+    /* Only this thread changes the mapping, scanned and count, so read them unlocked */
+    if (pos >= end || (data = MapLogWindow(li, &li->scan, pos, end)) == NULL)
+        return 0;
+
+    while (pos < end)
+    {
+        const char *line = data + (pos - start);
+        const char *eol = memchr(line, '\n', (size_t) (end - pos));
+        ULONGLONG next;
+
+        /* An incomplete line is picked up with the next chunk or remap,
+         * unless it fills a whole chunk by itself */
+        if (eol == NULL && (pos > start || end - pos < INDEX_CHUNK))
+            break;
+        next = eol ? pos + (eol - line) + 1 : end;
+
+        AcquireSRWLockExclusive(&li->lock);
+        if (li->count == li->capacity)
+        {
+            size_t cap = max(li->capacity * 2, (size_t) 65536);
+            ULONGLONG *offset = realloc(li->offset, cap * sizeof(*offset));
+            BYTE *flags = offset ? realloc(li->flags, cap * sizeof(*flags)) : NULL;
+            if (offset)
+                li->offset = offset;
+            if (flags)
+                li->flags = flags;
+            if (!offset || !flags)
+            {
+                ReleaseSRWLockExclusive(&li->lock);
+                break;
+            }
+            li->capacity = cap;
+        }
+        li->offset[li->count] = pos;
+        li->flags[li->count] = LogIndexGuessFlags(line, (size_t) (next - pos));
+        li->count++;
+        li->scanned = next;
+        ReleaseSRWLockExclusive(&li->lock);
+
+        pos = next;
+        added++;
+    }
+    return added;
+}
+
+/*
+ * Add up to INDEX_TEXT_LINES indexed lines to the text index. Returns the
+ * # of lines added.
+ */
+static size_t
+IndexText(log_index_t *li)
+{
+    WCHAR text[MAX_LOG_LENGTH + 1];
+    size_t n, end;
+
+    /* Only this thread changes count and text_lines, so read them unlocked */
+    end = min(li->count, li->text_lines + INDEX_TEXT_LINES);
+    for (n = li->text_lines; n < end && !li->text.incomplete; ++n)
+    {
+        if (LogIndexLine(li, n, text, _countof(text), NULL))
+            TextIndexAdd(&li->text, n, text, wcslen(text));
+    }
+    if (li->text.incomplete)
+        n = li->count;
+
+    AcquireSRWLockExclusive(&li->lock);
+    end = n - li->text_lines;
+    li->text_lines = n;
+    ReleaseSRWLockExclusive(&li->lock);
+    return end;
+}
+
+static DWORD WINAPI
+LogIndexThread(void *p)
+{
+    log_index_t *li = p;
+    unsigned int resets = 0;
+
+    do
+    {
+        BOOL changed = RemapLogFile(li) && li->resets != resets;
+
+        resets = li->resets;
+        while (li->mapping && IndexChunk(li) > 0)
+        {
+            changed = TRUE;
+            if (InterlockedExchange(&li->notified, 1) == 0)
+                PostMessage(li->hwnd, li->msg, 0, 0);
+            if (WaitForSingleObject(li->stop, 0) == WAIT_OBJECT_0)
+                return 0;
+        }
+        /* Let the window know the file was truncated even if it is empty */
+        if (changed && InterlockedExchange(&li->notified, 1) == 0)
+            PostMessage(li->hwnd, li->msg, 0, 0);
+
+        /* Catch up with the text index once it is needed */
+        while (li->text_wanted && IndexText(li) > 0)
+        {
+            if (WaitForSingleObject(li->stop, 0) == WAIT_OBJECT_0)
+                return 0;
+        }
+    } while (WaitForSingleObject(li->stop, INDEX_POLL) == WAIT_TIMEOUT);
+
+    return 0;
+}
+
+/*
+ * Open a log file and start indexing it in the background
+ */
+BOOL
+OpenLogIndex(log_index_t *li, const WCHAR *path, HWND hwnd, UINT msg)
+{
+    CLEAR(*li);
+    InitializeSRWLock(&li->lock);
+    InitializeSRWLock(&li->view_lock);
+    TextIndexInit(&li->text);
+
+    if (!granularity)
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        granularity = si.dwAllocationGranularity;
+    }
+    wcsncpy(li->path, path, _countof(li->path));
+    li->path[_countof(li->path) - 1] = L'\0';
+    li->hwnd = hwnd;
+    li->msg = msg;
+
+    li->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                          NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (li->file == INVALID_HANDLE_VALUE)
+    {
+        li->file = NULL;
+        return FALSE;
+    }
+
+    li->stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (li->stop)
+        li->thread = CreateThread(NULL, 0, LogIndexThread, li, 0, NULL);
+    if (li->thread == NULL)
+    {
+        CloseLogIndex(li);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Stop indexing and release the file
+ */
+void
+CloseLogIndex(log_index_t *li)
+{
+    if (li->thread)
+    {
+        SetEvent(li->stop);
+        WaitForSingleObject(li->thread, INFINITE);
+        CloseHandle(li->thread);
+    }
+    if (li->stop)
+        CloseHandle(li->stop);
+    UnmapLogWindow(&li->scan);
+    UnmapLogWindow(&li->view);
+    if (li->mapping)
+        CloseHandle(li->mapping);
+    if (li->file)
+        CloseHandle(li->file);
+    free(li->offset);
+    free(li->flags);
+    TextIndexFree(&li->text);
+    CLEAR(*li);
+}
+
+/*
+ * Get the # of indexed lines and acknowledge the last notification.
+ * resets is set to the # of times the file was found truncated.
+ */
+size_t
+LogIndexCount(log_index_t *li, unsigned int *resets)
+{
+    size_t count;
+
+    InterlockedExchange(&li->notified, 0);
+    AcquireSRWLockShared(&li->lock);
+    count = li->count;
+    if (resets)
+        *resets = li->resets;
+    ReleaseSRWLockShared(&li->lock);
+    return count;
+}
+
+/*
+ * Copy line n without the line end to buf and get its flags.
+ * buf may be NULL to get the flags only.
+ */
+BOOL
+LogIndexLine(log_index_t *li, size_t n, WCHAR *buf, size_t size, BYTE *flags)
+{
+    BOOL ret = FALSE;
+    const char *line;
+    WCHAR wide[MAX_LOG_LENGTH];
+    size_t len;
+    int nch;
+
+    if (buf && size == 0)
+        return FALSE;
+    if (buf)
+        buf[0] = L'\0';
+
+    AcquireSRWLockShared(&li->lock);
+    if (n < li->count && buf == NULL)
+    {
+        if (flags)
+            *flags = li->flags[n];
+        ret = TRUE;
+    }
+    else if (n < li->count)
+    {
+        /* Only as much of a long line as is shown needs to be mapped */
+        ULONGLONG pos = li->offset[n];
+        len = (size_t) min((n + 1 < li->count ? li->offset[n + 1] : li->scanned) - pos,
+                           (ULONGLONG) MAX_LOG_LENGTH + 3);
+
+        AcquireSRWLockExclusive(&li->view_lock);
+        line = MapLogWindow(li, &li->view, pos, pos + len);
+        if (line)
+        {
+            /* Strip line end and UTF-8 byte order mark */
+            while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+                len--;
+            if (n == 0 && len >= 3 && memcmp(line, "\xEF\xBB\xBF", 3) == 0)
+            {
+                line += 3;
+                len -= 3;
+            }
+
+            /* Converting fails if buf is too small, truncate a copy instead */
+            len = min(len, (size_t) MAX_LOG_LENGTH);
+            nch = MultiByteToWideChar(CP_UTF8, 0, line, (int) len, wide, _countof(wide));
+            nch = min(nch, (int) size - 1);
+            wmemcpy(buf, wide, nch);
+            buf[nch] = L'\0';
+            if (flags)
+                *flags = li->flags[n];
+            ret = TRUE;
+        }
+        ReleaseSRWLockExclusive(&li->view_lock);
+    }
+    ReleaseSRWLockShared(&li->lock);
+    return ret;
+}
+
+/*
+ * Look for query in lines n to end. Returns FALSE if there is none.
+ */
+static BOOL
+ScanLines(log_index_t *li, const WCHAR *query, size_t n, size_t end, size_t *found)
+{
+    WCHAR line[MAX_LOG_LENGTH + 1];
+
+    for ( ; n < end; ++n)
+    {
+        if (LogIndexLine(li, n, line, _countof(line), NULL) && TextMatch(line, query))
+        {
+            *found = n;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Find the first line from line n on that contains query, ignoring
+ * case. Returns FALSE if there is none. The text index is only built
+ * in the background after the first search; lines not in it yet are
+ * looked at one by one.
+ */
+BOOL
+LogIndexFind(log_index_t *li, const WCHAR *query, size_t n, size_t *found)
+{
+    size_t count, indexed, i, nblocks, from;
+    DWORD *blocks;
+
+    InterlockedExchange(&li->text_wanted, 1);
+
+    AcquireSRWLockShared(&li->lock);
+    count = li->count;
+    indexed = li->text_lines;
+    ReleaseSRWLockShared(&li->lock);
+
+    /* Short queries are not indexed, look at every line */
+    if (!TextIndexQuery(&li->text, query, &blocks, &nblocks))
+        return ScanLines(li, query, n, count, found);
+
+    for (i = 0; i < nblocks; ++i)
+    {
+        from = max(n, (size_t) blocks[i] * TEXT_INDEX_BLOCK);
+        if (from >= indexed)
+            break;
+        if (ScanLines(li, query, from, min(((size_t) blocks[i] + 1) * TEXT_INDEX_BLOCK, indexed), found))
+        {
+            free(blocks);
+            return TRUE;
+        }
+    }
+    free(blocks);
+    return ScanLines(li, query, max(n, indexed), count, found);
+}
+
+/*
+ * Find lines from line from on with any of the flags in mask. Up to max
+ * line numbers are stored in rows, next is set to the line to continue
+ * with. Returns the # of lines found.
+ */
+size_t
+LogIndexFilter(log_index_t *li, BYTE mask, size_t from, size_t *rows, size_t max, size_t *next)
+{
+    size_t n = 0;
+
+    AcquireSRWLockShared(&li->lock);
+    while (from < li->count && n < max)
+    {
+        if (li->flags[from] & mask)
+            rows[n++] = from;
+        from++;
+    }
+    ReleaseSRWLockShared(&li->lock);
+
+    *next = from;
+    return n;
+}
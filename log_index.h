@@ -0,0 +1,74 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include <windows.h>
+
+#include "text_index.h"
+
+/* A view of a part of the mapped file */
+typedef struct {
+    const char *data;
+    ULONGLONG base;         /* offset of data in the file */
+    size_t size;
+} log_window_t;
+
+/*
+ * Index of the lines of a log file. The file is memory mapped and a
+ * background thread records the offset of each line, remapping the file
+ * as it grows. Only windows of up to LOG_WINDOW_SIZE bytes of the file are
+ * mapped at a time, so that files larger than the address space can be
+ * shown. The window hwnd is sent msg when new lines were indexed.
+ */
+typedef struct {
+    SRWLOCK lock;
+    SRWLOCK view_lock;      /* serializes the use of view */
+    WCHAR path[MAX_PATH];
+    HANDLE file;
+    HANDLE mapping;
+    ULONGLONG size;         /* size of the mapping */
+    log_window_t scan;      /* window being indexed, used by the thread only */
+    log_window_t view;      /* window lines are read from */
+    ULONGLONG *offset;      /* start of each indexed line */
+    BYTE *flags;            /* LOG_FLAG_* of each indexed line */
+    size_t count;           /* # of indexed lines */
+    size_t capacity;        /* allocated entries of offset and flags */
+    ULONGLONG scanned;      /* end of the last indexed line */
+    unsigned int resets;    /* # of times the file was truncated */
+    text_index_t text;      /* trigrams of the lines for LogIndexFind */
+    size_t text_lines;      /* # of lines added to text */
+    volatile LONG text_wanted; /* text is built once LogIndexFind was used */
+    HANDLE thread;
+    HANDLE stop;            /* event to stop the thread */
+    HWND hwnd;
+    UINT msg;
+    volatile LONG notified; /* msg was posted and not yet handled */
+} log_index_t;
+
+BOOL OpenLogIndex(log_index_t *li, const WCHAR *path, HWND hwnd, UINT msg);
+void CloseLogIndex(log_index_t *li);
+size_t LogIndexCount(log_index_t *li, unsigned int *resets);
+BOOL LogIndexLine(log_index_t *li, size_t n, WCHAR *buf, size_t size, BYTE *flags);
+BYTE LogIndexGuessFlags(const char *line, size_t len);
+BOOL LogIndexFind(log_index_t *li, const WCHAR *query, size_t n, size_t *found);
+size_t LogIndexFilter(log_index_t *li, BYTE mask, size_t from, size_t *rows, size_t max, size_t *next);
+
+#endif
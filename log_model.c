@@ -0,0 +1,239 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include "main.h"
+#include "log_model.h"
+#include "text_index.h"
+
+/* Average # of characters per message the text ring is sized for */
+#define LOG_AVG_LINE 96
+
+/* Longest message stored, longer ones are truncated */
+#define LOG_MAX_LEN MAX_LOG_LENGTH
+
+#define REC(m, n) ((m)->rec[(n) % (m)->capacity])
+
+/*
+ * Allocate the rings of a log model for capacity records. The model
+ * must be zeroed or freed before. Other threads may keep reading it,
+ * so the lock is not reinitialized and record numbers continue from
+ * the previous use of the model.
+ */
+BOOL
+LogModelInit(log_model_t *m, unsigned int capacity)
+{
+    log_record_t *rec = malloc(capacity * sizeof(*rec));
+    WCHAR *text = malloc((size_t) capacity * LOG_AVG_LINE * sizeof(*text));
+
+    if (rec == NULL || text == NULL)
+    {
+        free(rec);
+        free(text);
+        return FALSE;
+    }
+
+    AcquireSRWLockExclusive(&m->lock);
+    m->rec = rec;
+    m->text = text;
+    m->capacity = capacity;
+    m->text_size = (size_t) capacity * LOG_AVG_LINE;
+    m->text_end = 0;
+    m->first = m->next;
+    TextIndexClear(&m->index);
+    ReleaseSRWLockExclusive(&m->lock);
+    return TRUE;
+}
+
+void
+LogModelFree(log_model_t *m)
+{
+    AcquireSRWLockExclusive(&m->lock);
+    free(m->rec);
+    free(m->text);
+    m->rec = NULL;
+    m->text = NULL;
+    m->capacity = 0;
+    m->first = m->next;
+    TextIndexClear(&m->index);
+    ReleaseSRWLockExclusive(&m->lock);
+}
+
+/*
+ * Add a record with the message prefix followed by msg
+ */
+void
+LogModelAdd(log_model_t *m, time_t timestamp, WORD flags, const WCHAR *prefix, const WCHAR *msg)
+{
+    size_t plen = wcslen(prefix);
+    size_t len = plen + wcslen(msg);
+    size_t pos;
+    log_record_t *r;
+
+    if (len > LOG_MAX_LEN)
+        len = LOG_MAX_LEN;
+    if (plen > len)
+        plen = len;
+
+    AcquireSRWLockExclusive(&m->lock);
+    if (m->rec == NULL)
+        goto out;
+
+    /* Messages are stored contiguously, skip the tail of the ring if required */
+    pos = m->text_end % m->text_size;
+    if (pos + len > m->text_size)
+        m->text_end += m->text_size - pos;
+
+    r = &REC(m, m->next);
+    r->offset = m->text_end;
+    r->timestamp = timestamp;
+    r->len = (WORD) len;
+    r->flags = flags;
+
+    pos = m->text_end % m->text_size;
+    wmemcpy(m->text + pos, prefix, plen);
+    wmemcpy(m->text + pos + plen, msg, len - plen);
+    m->text_end += len;
+    TextIndexAdd(&m->index, m->next, m->text + pos, len);
+    m->next++;
+
+    /* Drop records that were overwritten */
+    if (m->next - m->first > m->capacity)
+        m->first = m->next - m->capacity;
+    while (m->first < m->next && REC(m, m->first).offset + m->text_size < m->text_end)
+        m->first++;
+    TextIndexExpire(&m->index, m->first);
+
+out:
+    ReleaseSRWLockExclusive(&m->lock);
+}
+
+/*
+ * Get the numbers of the oldest record and the next record to be added
+ */
+void
+LogModelRange(log_model_t *m, ULONGLONG *first, ULONGLONG *next)
+{
+    AcquireSRWLockShared(&m->lock);
+    *first = m->first;
+    *next = m->next;
+    ReleaseSRWLockShared(&m->lock);
+}
+
+/*
+ * Copy record n and its message into rec and buf. Returns FALSE if the
+ * record is no longer or not yet in the model.
+ */
+BOOL
+LogModelGet(log_model_t *m, ULONGLONG n, log_record_t *rec, WCHAR *buf, size_t size)
+{
+    BOOL ret = FALSE;
+
+    AcquireSRWLockShared(&m->lock);
+    if (n >= m->first && n < m->next)
+    {
+        *rec = REC(m, n);
+        if (buf && size)
+        {
+            size_t len = min((size_t) rec->len, size - 1);
+            wmemcpy(buf, m->text + rec->offset % m->text_size, len);
+            buf[len] = L'\0';
+        }
+        ret = TRUE;
+    }
+    ReleaseSRWLockShared(&m->lock);
+    return ret;
+}
+
+/*
+ * Find the first record from n on whose message contains query,
+ * ignoring case. Returns FALSE if there is none.
+ */
+BOOL
+LogModelFind(log_model_t *m, const WCHAR *query, ULONGLONG n, ULONGLONG *found)
+{
+    WCHAR msg[LOG_MAX_LEN + 1];
+    log_record_t rec;
+    ULONGLONG first, next, end;
+    DWORD *blocks;
+    size_t count, i;
+    BOOL ret = FALSE;
+
+    LogModelRange(m, &first, &next);
+    n = max(n, first);
+
+    /* Short queries are not indexed, look at every record */
+    if (!TextIndexQuery(&m->index, query, &blocks, &count))
+    {
+        for ( ; n < next; ++n)
+        {
+            if (LogModelGet(m, n, &rec, msg, _countof(msg)) && TextMatch(msg, query))
+            {
+                *found = n;
+                return TRUE;
+            }
+        }
+        return FALSE;
+    }
+
+    for (i = 0; i < count && !ret; ++i)
+    {
+        end = ((ULONGLONG) blocks[i] + 1) * TEXT_INDEX_BLOCK;
+        for (n = max(n, (ULONGLONG) blocks[i] * TEXT_INDEX_BLOCK); n < end && n < next; ++n)
+        {
+            if (LogModelGet(m, n, &rec, msg, _countof(msg)) && TextMatch(msg, query))
+            {
+                *found = n;
+                ret = TRUE;
+                break;
+            }
+        }
+    }
+    free(blocks);
+    return ret;
+}
+
+/*
+ * Convert the flags field of a management log line to LOG_FLAG_*
+ */
+WORD
+LogModelParseFlags(const char *flags, size_t len)
+{
+    WORD ret = 0;
+
+    while (len--)
+    {
+        switch (*flags++)
+        {
+        case 'I': ret |= LOG_FLAG_INFO; break;
+        case 'F': ret |= LOG_FLAG_FATAL; break;
+        case 'N': ret |= LOG_FLAG_NONFATAL; break;
+        case 'W': ret |= LOG_FLAG_WARN; break;
+        case 'D': ret |= LOG_FLAG_DEBUG; break;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,69 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOG_MODEL_H
+#define LOG_MODEL_H
+
+#include <windows.h>
+#include <time.h>
+
+#include "text_index.h"
+
+/* Flags of log records, as set by OpenVPN in the log line */
+#define LOG_FLAG_INFO       (1<<0)      /* I */
+#define LOG_FLAG_FATAL      (1<<1)      /* F */
+#define LOG_FLAG_NONFATAL   (1<<2)      /* N */
+#define LOG_FLAG_WARN       (1<<3)      /* W */
+#define LOG_FLAG_DEBUG      (1<<4)      /* D */
+#define LOG_FLAG_GUI        (1<<5)      /* line from the GUI itself */
+
+typedef struct {
+    ULONGLONG offset;       /* position of the message in the text ring */
+    time_t timestamp;
+    WORD len;               /* length of the message in characters */
+    WORD flags;             /* LOG_FLAG_* */
+} log_record_t;
+
+/*
+ * Most recent log records of a connection. Records and their messages
+ * are kept in two rings: when either is full the oldest records are
+ * dropped. Records are numbered in the order they were added, starting
+ * with 0, so a record keeps its number while it is in the model.
+ */
+typedef struct {
+    SRWLOCK lock;
+    log_record_t *rec;
+    unsigned int capacity;  /* max # of records */
+    ULONGLONG first;        /* number of the oldest record */
+    ULONGLONG next;         /* number of the next record to be added */
+    WCHAR *text;
+    size_t text_size;       /* size of the text ring in characters */
+    ULONGLONG text_end;     /* position after the last message */
+    text_index_t index;     /* trigrams of the messages for LogModelFind */
+} log_model_t;
+
+BOOL LogModelInit(log_model_t *m, unsigned int capacity);
+void LogModelFree(log_model_t *m);
+void LogModelAdd(log_model_t *m, time_t timestamp, WORD flags, const WCHAR *prefix, const WCHAR *msg);
+void LogModelRange(log_model_t *m, ULONGLONG *first, ULONGLONG *next);
+BOOL LogModelGet(log_model_t *m, ULONGLONG n, log_record_t *rec, WCHAR *buf, size_t size);
+BOOL LogModelFind(log_model_t *m, const WCHAR *query, ULONGLONG n, ULONGLONG *found);
+WORD LogModelParseFlags(const char *flags, size_t len);
+
+#endif
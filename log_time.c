@@ -0,0 +1,52 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <wchar.h>
+#include <time.h>
+
+#include "log_time.h"
+
+/*
+ * Format t like ctime() without the trailing newline. Log lines arrive
+ * in bursts sharing the same second, so each thread keeps the string of
+ * the last second it formatted. The string is valid until the next call
+ * in the same thread.
+ */
+const WCHAR *
+LogTimeString(time_t t)
+{
+    static __thread time_t cached_time;
+    static __thread WCHAR cached[25];
+    const WCHAR *s;
+
+    if (t != cached_time || cached[0] == L'\0')
+    {
+        s = _wctime(&t);
+        wcsncpy(cached, (s ? s : L""), 24);
+        cached[24] = L'\0';
+        cached_time = t;
+    }
+    return cached;
+}
@@ -0,0 +1,333 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <stdlib.h>
+
+#include "main.h"
+#include "log_writer.h"
+
+/*
+ * A file written by the log writer thread. The thread opens the file on
+ * the first write and is the only one to touch handle. Data is queued in
+ * buf under the writer lock, so callers never wait for the disk.
+ */
+struct log_file {
+    struct log_file *next;
+    WCHAR path[MAX_PATH];
+    int flags;
+    HANDLE handle;
+    char *buf;                  /* data waiting to be written */
+    size_t len;
+    size_t size;
+    unsigned int dropped;       /* # of bytes dropped as too much was pending */
+    BOOL closing;               /* close and free once all data is written */
+};
+
+static struct {
+    SRWLOCK lock;
+    log_file_t *files;
+    HANDLE thread;
+    HANDLE wakeup;              /* auto-reset event to write queued data now */
+    volatile LONG stop;
+} writer = { .lock = SRWLOCK_INIT };
+
+/*
+ * Write the queued data of a file to disk
+ */
+static void
+WriteQueued(log_file_t *f)
+{
+    char *data;
+    size_t len;
+    DWORD written;
+
+    AcquireSRWLockExclusive(&writer.lock);
+    data = f->buf;
+    len = f->len;
+    f->buf = NULL;
+    f->len = f->size = 0;
+    ReleaseSRWLockExclusive(&writer.lock);
+
+    if (len && f->handle == NULL)
+    {
+        f->handle = CreateFile(f->path, FILE_APPEND_DATA,
+                               FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                               NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (f->handle == INVALID_HANDLE_VALUE)
+        {
+            PrintDebug(L"Log writer: cannot open %s: error = %lu", f->path, GetLastError());
+            f->handle = NULL;
+        }
+        else if ((f->flags & LOG_FILE_UTF8) && GetFileSize(f->handle, NULL) == 0)
+        {
+            WriteFile(f->handle, "\xEF\xBB\xBF", 3, &written, NULL);
+        }
+    }
+
+    if (len && f->handle)
+        WriteFile(f->handle, data, len, &written, NULL);
+    free(data);
+}
+
+/*
+ * Write the queued data of all files, and close the files that are done
+ */
+static void
+WriteAll(void)
+{
+    log_file_t *f, **pf;
+    BOOL closing;
+
+    AcquireSRWLockShared(&writer.lock);
+    f = writer.files;
+    ReleaseSRWLockShared(&writer.lock);
+
+    /* Files are only added at the head and only removed by this thread */
+    while (f)
+    {
+        log_file_t *next = f->next;
+
+        WriteQueued(f);
+
+        AcquireSRWLockExclusive(&writer.lock);
+        closing = (f->closing && f->len == 0);
+        if (closing)
+        {
+            for (pf = &writer.files; *pf != f; pf = &(*pf)->next)
+                ;
+            *pf = f->next;
+        }
+        ReleaseSRWLockExclusive(&writer.lock);
+
+        if (closing)
+        {
+            if (f->dropped)
+                PrintDebug(L"Log writer: dropped %u bytes for %s", f->dropped, f->path);
+            if (f->handle)
+                CloseHandle(f->handle);
+            free(f);
+        }
+        f = next;
+    }
+}
+
+static DWORD WINAPI
+LogWriterThread(UNUSED void *p)
+{
+    while (!writer.stop)
+    {
+        WaitForSingleObject(writer.wakeup, LOG_WRITER_INTERVAL);
+        WriteAll();
+    }
+    WriteAll();
+    return 0;
+}
+
+/*
+ * Start the log writer thread
+ */
+BOOL
+InitLogWriter(void)
+{
+    writer.wakeup = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (writer.wakeup == NULL)
+        return FALSE;
+
+    writer.thread = CreateThread(NULL, 0, LogWriterThread, NULL, 0, NULL);
+    if (writer.thread == NULL)
+    {
+        CloseHandle(writer.wakeup);
+        writer.wakeup = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Write all queued data and stop the log writer thread
+ */
+void
+CloseLogWriter(void)
+{
+    if (writer.thread == NULL)
+        return;
+
+    InterlockedExchange(&writer.stop, 1);
+    SetEvent(writer.wakeup);
+    WaitForSingleObject(writer.thread, INFINITE);
+    CloseHandle(writer.thread);
+    CloseHandle(writer.wakeup);
+    writer.thread = NULL;
+    writer.wakeup = NULL;
+}
+
+/*
+ * Register a file to append to. The file is opened by the writer thread
+ * when data is first written to it.
+ */
+log_file_t *
+OpenLogFile(const WCHAR *path, int flags)
+{
+    log_file_t *f;
+
+    if (writer.thread == NULL)
+        return NULL;
+
+    f = calloc(1, sizeof(*f));
+    if (f == NULL)
+        return NULL;
+
+    wcsncpy(f->path, path, _countof(f->path));
+    f->path[_countof(f->path) - 1] = L'\0';
+    f->flags = flags;
+
+    AcquireSRWLockExclusive(&writer.lock);
+    f->next = writer.files;
+    writer.files = f;
+    ReleaseSRWLockExclusive(&writer.lock);
+
+    return f;
+}
+
+/*
+ * Queue data to be appended to a file
+ */
+BOOL
+WriteLogFile(log_file_t *f, const void *data, size_t size)
+{
+    BOOL ret = FALSE;
+
+    if (f == NULL)
+        return FALSE;
+
+    AcquireSRWLockExclusive(&writer.lock);
+    if (f->len + size > LOG_WRITER_MAX_PENDING)
+    {
+        f->dropped += size;
+        goto out;
+    }
+    if (f->len + size > f->size)
+    {
+        size_t new_size = max(max(f->size * 2, f->len + size), 4096);
+        char *buf = realloc(f->buf, new_size);
+        if (buf == NULL)
+        {
+            f->dropped += size;
+            goto out;
+        }
+        f->buf = buf;
+        f->size = new_size;
+    }
+    memcpy(f->buf + f->len, data, size);
+    f->len += size;
+    ret = TRUE;
+
+out:
+    ReleaseSRWLockExclusive(&writer.lock);
+    return ret;
+}
+
+/*
+ * Queue a string to be appended to a file in UTF-8
+ */
+BOOL
+WriteLogFileText(log_file_t *f, const WCHAR *text)
+{
+    char buf[1024];
+    char *utf8 = buf;
+    int len;
+    BOOL ret;
+
+    len = WideCharToMultiByte(CP_UTF8, 0, text, -1, NULL, 0, NULL, NULL);
+    if (len <= 0)
+        return FALSE;
+    if (len > (int) sizeof(buf))
+    {
+        utf8 = malloc(len);
+        if (utf8 == NULL)
+            return FALSE;
+    }
+
+    WideCharToMultiByte(CP_UTF8, 0, text, -1, utf8, len, NULL, NULL);
+    ret = WriteLogFile(f, utf8, len - 1);
+
+    if (utf8 != buf)
+        free(utf8);
+    return ret;
+}
+
+/*
+ * Have queued data written without waiting for the next interval
+ */
+void
+FlushLogFile(log_file_t *f)
+{
+    if (f && writer.wakeup)
+        SetEvent(writer.wakeup);
+}
+
+/*
+ * Wait until earlier files with this path have been written and closed
+ * by the writer thread. Returns FALSE on timeout.
+ */
+BOOL
+WaitLogFileClosed(const WCHAR *path, DWORD timeout)
+{
+    DWORD start = GetTickCount();
+    log_file_t *f;
+    BOOL busy;
+
+    while (writer.thread)
+    {
+        AcquireSRWLockShared(&writer.lock);
+        for (f = writer.files; f && _wcsicmp(f->path, path) != 0; f = f->next)
+            ;
+        busy = (f != NULL);
+        ReleaseSRWLockShared(&writer.lock);
+
+        if (!busy)
+            return TRUE;
+        if (GetTickCount() - start >= timeout)
+            return FALSE;
+        SetEvent(writer.wakeup);
+        Sleep(10);
+    }
+    return TRUE;
+}
+
+/*
+ * Write the queued data and close the file. The file must not be used
+ * after this call, it is freed by the writer thread.
+ */
+void
+CloseLogFile(log_file_t *f)
+{
+    if (f == NULL)
+        return;
+
+    AcquireSRWLockExclusive(&writer.lock);
+    f->closing = TRUE;
+    ReleaseSRWLockExclusive(&writer.lock);
+    SetEvent(writer.wakeup);
+}
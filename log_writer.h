@@ -0,0 +1,46 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <windows.h>
+
+/* Milliseconds between writes of queued data to disk */
+#define LOG_WRITER_INTERVAL 1000
+
+/* Max # of bytes queued per file, more data is dropped */
+#define LOG_WRITER_MAX_PENDING (4 * 1024 * 1024)
+
+/* Flags for OpenLogFile */
+#define LOG_FILE_UTF8   (1<<0)  /* text file: start new files with a BOM */
+
+typedef struct log_file log_file_t;
+
+BOOL InitLogWriter(void);
+void CloseLogWriter(void);
+
+log_file_t *OpenLogFile(const WCHAR *path, int flags);
+BOOL WriteLogFile(log_file_t *f, const void *data, size_t size);
+BOOL WriteLogFileText(log_file_t *f, const WCHAR *text);
+void FlushLogFile(log_file_t *f);
+BOOL WaitLogFileClosed(const WCHAR *path, DWORD timeout);
+void CloseLogFile(log_file_t *f);
+
+#endif
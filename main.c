@@ -33,11 +33,13 @@
 #include <prsht.h>
 #include <pbt.h>
 #include <commdlg.h>
+#include <commctrl.h>
 
 #include "tray.h"
 #include "openvpn.h"
 #include "openvpn_config.h"
 #include "viewlog.h"
+#include "timeline.h"
 #include "service.h"
 #include "main.h"
 #include "options.h"
@@ -49,6 +51,9 @@
 #include "manage.h"
 #include "misc.h"
 #include "save_pass.h"
+#include "autostart.h"
+#include "resume.h"
+#include "shutdown.h"
 
 #ifndef DISABLE_CHANGE_PASSWORD
 #include <openssl/evp.h>
@@ -122,6 +127,7 @@ int WINAPI _tWinMain (HINSTANCE hThisInstance,
       { needok,   OnNeedOk },
       { needstr,  OnNeedStr },
       { echo,     OnEcho },
+      { bytecount, OnByteCount },
       { 0,        NULL }
   };
   InitManagement(handler);
@@ -143,16 +149,12 @@ int WINAPI _tWinMain (HINSTANCE hThisInstance,
 
   o.hInstance = hThisInstance;
 
-  if(!GetModuleHandle(_T("RICHED20.DLL")))
-    {
-      LoadLibrary(_T("RICHED20.DLL"));
-    }
-  else
-    {
-      /* can't load riched20.dll */
-      ShowLocalizedMsg(IDS_ERR_LOAD_RICHED20);
-      exit(1);
-    }
+  /* Register the list view class used by the status window */
+  INITCOMMONCONTROLSEX icc = {
+      .dwSize = sizeof(icc),
+      .dwICC = ICC_LISTVIEW_CLASSES
+  };
+  InitCommonControlsEx(&icc);
 
   /* Check version of shell32.dll */
   shell32_version=GetDllVersion(_T("shell32.dll"));
@@ -246,6 +248,10 @@ int WINAPI _tWinMain (HINSTANCE hThisInstance,
            );
 
 
+  /* Start the thread writing log files in the background */
+  if (!InitLogWriter())
+      PrintDebug(L"Failed to start the log writer thread");
+
   /* Run the message loop. It will run until GetMessage() returns 0 */
   while (GetMessage (&messages, NULL, 0, 0))
   {
@@ -253,6 +259,8 @@ int WINAPI _tWinMain (HINSTANCE hThisInstance,
     DispatchMessage(&messages);
   }
 
+  CloseLogWriter();
+
   /* The program return-value is 0 - The value that PostQuitMessage() gave */
   return messages.wParam;
 }
@@ -261,53 +269,54 @@ int WINAPI _tWinMain (HINSTANCE hThisInstance,
 static void
 StopAllOpenVPN()
 {
-    int i;
+    CancelAutoStart();
 
-    for (i = 0; i < o.num_configs; i++)
-    {
-        if (o.conn[i].state != disconnected)
-            StopOpenVPN(&o.conn[i]);
-    }
-
-    /* Wait for all connections to terminate (Max 5 sec) */
-    for (i = 0; i < 20; i++, Sleep(250))
-    {
-        if (CountConnState(disconnected) == o.num_configs)
-            break;
-    }
+    /* Returns as soon as the last connection is down */
+    if (StartShutdown(NULL))
+        WaitShutdown(SHUTDOWN_SIGNAL_TIMEOUT + SHUTDOWN_EVENT_TIMEOUT + SHUTDOWN_KILL_TIMEOUT);
 }
 
 
 static int
 AutoStartConnections()
 {
-    int i;
+    connection_t *conn[MAX_CONFIGS];
+    int i, count = 0;
 
     for (i = 0; i < o.num_configs; i++)
     {
         if (o.conn[i].auto_connect)
-            StartOpenVPN(&o.conn[i]);
+            conn[count++] = &o.conn[i];
     }
+    StartAutoConnections(conn, count);
 
     return TRUE;
 }
 
 
+/*
+ * Have OpenVPN exit before the computer goes to sleep if suspend_on_sleep
+ * is set, the connections are restarted by ResumeConnections
+ */
 static void
-ResumeConnections()
+SuspendConnections()
 {
     int i;
     for (i = 0; i < o.num_configs; i++) {
-        /* Restart suspend connections */
-        if (o.conn[i].state == suspended)
-            StartOpenVPN(&o.conn[i]);
-
-        /* If some connection never reached SUSPENDED state */
-        if (o.conn[i].state == suspending)
-            StopOpenVPN(&o.conn[i]);
+        if (o.conn[i].hwndStatus)
+            SuspendOpenVPN(i);
     }
 }
 
+
+static void
+ResumeConnections()
+{
+    /* Restart suspended connections a few at a time, including those
+     * that have not reached SUSPENDED state yet */
+    ScheduleResume();
+}
+
 /*
  * Set scale factor of windows in pixels. Scale = 100% for dpi = 96
  */
@@ -414,6 +423,9 @@ LRESULT CALLBACK WindowProcedure (HWND hwnd, UINT message, WPARAM wParam, LPARAM
       if (LOWORD(wParam) == IDM_IMPORT) {
         ImportConfigFile();
       }
+      if (LOWORD(wParam) == IDM_TIMELINE) {
+        ShowLogTimeline();
+      }
       if (LOWORD(wParam) == IDM_SETTINGS) {
         ShowSettingsDialog();
       }
@@ -433,6 +445,23 @@ LRESULT CALLBACK WindowProcedure (HWND hwnd, UINT message, WPARAM wParam, LPARAM
       CloseApplication(hwnd);
       break;
 
+    case WM_AUTOSTART:
+      OnAutoStart((connection_t *) lParam);
+      break;
+
+    case WM_RESUME:
+      RunResumeQueue();
+      break;
+
+    case WM_SHUTDOWN:
+      DestroyWindow(hwnd);
+      break;
+
+    case WM_TIMER:
+      if (wParam == IDT_RESUME_TIMER)
+        RunResumeQueue();
+      break;
+
     case WM_DESTROY:
       WTSUnRegisterSessionNotification(hwnd);
       StopAllOpenVPN();	
@@ -448,6 +477,22 @@ LRESULT CALLBACK WindowProcedure (HWND hwnd, UINT message, WPARAM wParam, LPARAM
       OnDestroyTray();
       break;
 
+    case WM_POWERBROADCAST:
+      if (!o.suspend_on_sleep)
+        return TRUE;
+      switch (wParam) {
+        case PBT_APMSUSPEND:
+          SuspendConnections();
+          break;
+        case PBT_APMRESUMEAUTOMATIC:
+          /* A locked session resumes them once unlocked */
+          if (!o.session_locked
+              && (CountConnState(suspended) != 0 || CountConnState(suspending) != 0))
+            ResumeConnections();
+          break;
+      }
+      return TRUE;
+
     case WM_WTSSESSION_CHANGE:
       switch (wParam) {
         case WTS_SESSION_LOCK:
@@ -455,7 +500,7 @@ LRESULT CALLBACK WindowProcedure (HWND hwnd, UINT message, WPARAM wParam, LPARAM
           break;
         case WTS_SESSION_UNLOCK:
           o.session_locked = FALSE;
-          if (CountConnState(suspended) != 0)
+          if (CountConnState(suspended) != 0 || CountConnState(suspending) != 0)
             ResumeConnections();
           break;
       }
@@ -572,7 +617,10 @@ CloseApplication(HWND hwnd)
             return;
     }
 
-    DestroyWindow(hwnd);
+    /* Keep the tray responsive while connections go down */
+    CancelAutoStart();
+    if (!StartShutdown(hwnd))
+        DestroyWindow(hwnd);
 }
 
 void
@@ -38,8 +38,8 @@
 #define GUI_REGKEY_HKCU	_T("Software\\OpenVPN-GUI")
 
 #define MAX_LOG_LENGTH      1024/* Max number of characters per log line */
-#define MAX_LOG_LINES		500	/* Max number of lines in LogWindow */
-#define DEL_LOG_LINES		10	/* Number of lines to delete from LogWindow */
+#define LOG_FLUSH_INTERVAL	50	/* Milliseconds to collect lines before updating LogWindow */
+#define LOG_REPEAT_QUIET	1000	/* Milliseconds without repeats before reporting them */
 #define USAGE_BUF_SIZE		2048	/* Size of buffer used to display usage message */
 
 /* Authorized group who can use any options and config locations */
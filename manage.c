@@ -34,13 +34,53 @@
 
 extern options_t o;
 
+static void SendCommand(connection_t *c);
+
 static mgmt_msg_func rtmsg_handler[mgmt_rtmsg_type_max];
 
+#define RTMSG(prefix, type) { prefix, sizeof(prefix) - 1, type }
+
+/*
+ * Prefixes of real-time notifications. Entries starting with the
+ * same character have to be adjacent for the lookup to find them.
+ */
+static const struct {
+    const char *prefix;
+    size_t len;
+    mgmt_rtmsg_type type;
+} rtmsg_table[] = {
+    RTMSG("BYTECOUNT:", bytecount),
+    RTMSG("ECHO:", echo),
+    RTMSG("HOLD:", hold),
+    RTMSG("INFO:", ready),
+    RTMSG("LOG:", log),
+    RTMSG("NEED-OK:", needok),
+    RTMSG("NEED-STR:", needstr),
+    RTMSG("PASSWORD:", password),
+    RTMSG("PKCS11ID-COUNT:", pkcs11_id_count),
+    RTMSG("PROXY:", proxy),
+    RTMSG("STATE:", state)
+};
+
+/*
+ * Range of rtmsg_table entries for each initial character 'A' to 'Z'
+ */
+static struct {
+    BYTE first;
+    BYTE count;
+} rtmsg_index[26];
+
 /*
  * Number of seconds to try connecting to management interface
  */
 static const time_t max_connect_time = 15;
 
+/*
+ * Initial and maximum size of the management receive buffer
+ */
+static const size_t rbuf_init_size = 16384;
+static const size_t rbuf_max_size = 1024 * 1024;
+
 /*
  * Initialize the real-time notification handlers
  */
@@ -52,8 +92,142 @@ InitManagement(const mgmt_rtmsg_handler *handler)
     {
         rtmsg_handler[handler[i].type] = handler[i].handler;
     }
+
+    for (i = _countof(rtmsg_table) - 1; i >= 0; --i)
+    {
+        int n = rtmsg_table[i].prefix[0] - 'A';
+        rtmsg_index[n].first = i;
+        rtmsg_index[n].count++;
+    }
+}
+
+
+/*
+ * The management interface announced itself with >INFO: after accepting
+ * our password. It processes commands from now on, so let the handler
+ * queue its commands and release anything held back until now.
+ */
+static void
+OnManagementReady(connection_t *c, char *msg)
+{
+    c->manage.ready = TRUE;
+    if (rtmsg_handler[ready])
+        rtmsg_handler[ready](c, msg);
+    SendCommand(c);
+}
+
+
+/*
+ * Call the handler for a real-time notification. The message is
+ * expected without the leading '>'.
+ */
+static void
+DispatchRtmsg(connection_t *c, char *msg)
+{
+    unsigned int n = (unsigned char) msg[0] - 'A';
+    int i, last;
+
+    if (n < _countof(rtmsg_index))
+    {
+        last = rtmsg_index[n].first + rtmsg_index[n].count;
+        for (i = rtmsg_index[n].first; i < last; ++i)
+        {
+            if (strncmp(msg, rtmsg_table[i].prefix, rtmsg_table[i].len) != 0)
+                continue;
+
+            if (rtmsg_table[i].type == ready)
+            {
+                OnManagementReady(c, msg + rtmsg_table[i].len);
+                return;
+            }
+            if (rtmsg_handler[rtmsg_table[i].type])
+                rtmsg_handler[rtmsg_table[i].type](c, msg + rtmsg_table[i].len);
+            return;
+        }
+    }
+
+    c->manage.unknown_rtmsg++;
+    PrintDebug(L"Unknown real-time notification: >%.32S", msg);
+}
+
+/*
+ * Start a transcript of the data received from the management interface
+ */
+static void
+OpenRecord(connection_t *c)
+{
+    WCHAR path[MAX_PATH];
+    WCHAR *ext;
+    DWORD written;
+    static const char header[] = "# OpenVPN GUI management interface transcript\n";
+
+    wcsncpy(path, c->log_path, _countof(path));
+    path[_countof(path) - 1] = L'\0';
+    ext = wcsrchr(path, L'.');
+    if (ext == NULL || (size_t) (ext - path) + 6 > _countof(path))
+        return;
+    wcscpy(ext, L".mgmt");
+
+    c->manage.record = CreateFile(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL,
+                                  OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (c->manage.record == INVALID_HANDLE_VALUE)
+    {
+        PrintDebug(L"Failed to open management transcript %s: error = %lu", path, GetLastError());
+        c->manage.record = NULL;
+        return;
+    }
+    c->manage.record_start = GetTickCount();
+    WriteFile(c->manage.record, header, sizeof(header) - 1, &written, NULL);
+}
+
+
+/*
+ * Append a chunk of received data to the transcript
+ */
+static void
+WriteRecord(connection_t *c, const char *data, int size)
+{
+    char header[32];
+    DWORD written;
+
+    _snprintf_0(header, "@%lu %d\n", GetTickCount() - c->manage.record_start, size);
+    WriteFile(c->manage.record, header, strlen(header), &written, NULL);
+    WriteFile(c->manage.record, data, size, &written, NULL);
+    WriteFile(c->manage.record, "\n", 1, &written, NULL);
+}
+
+
+/*
+ * Summarize the management interface counters and end the transcript
+ */
+static void
+CloseRecord(connection_t *c)
+{
+    mgmt_stats_t *s = &c->manage.stats;
+    LARGE_INTEGER freq;
+    char msg[256];
+    DWORD written;
+    double avg = 0, max = 0;
+
+    if (QueryPerformanceFrequency(&freq) && s->lines)
+    {
+        avg = (double) s->handler_time * 1e6 / freq.QuadPart / s->lines;
+        max = (double) s->handler_max * 1e6 / freq.QuadPart;
+    }
+    _snprintf_0(msg, "# lines=%I64u bytes=%I64u allocs=%u allocs/line=%.3f handler avg=%.1fus max=%.1fus "
+                "dropped=%u late=%u\n", s->lines, s->bytes, s->allocs,
+                s->lines ? (double) s->allocs / s->lines : 0.0, avg, max, s->dropped, s->late);
+    PrintDebug(L"Management interface of %s: %S", c->config_name, msg + 2);
+
+    if (c->manage.record)
+    {
+        WriteFile(c->manage.record, msg, strlen(msg), &written, NULL);
+        CloseHandle(c->manage.record);
+        c->manage.record = NULL;
+    }
 }
 
+
 /*
  * Connect to the OpenVPN management interface and register
  * asynchronous socket event notification for it
@@ -66,12 +240,17 @@ OpenManagement(connection_t *c)
         return FALSE;
 
     c->manage.connected = FALSE;
+    c->manage.ready = FALSE;
+    CLEAR(c->manage.stats);
     c->manage.sk = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (c->manage.sk == INVALID_SOCKET)
     {
         WSACleanup ();
         return FALSE;
     }
+    MapConnManagement(c);
+    if (o.mgmt_record)
+        OpenRecord(c);
     if (WSAAsyncSelect(c->manage.sk, c->hwndStatus, WM_MANAGEMENT,
         FD_CONNECT|FD_READ|FD_WRITE|FD_CLOSE) != 0)
         return FALSE;
@@ -84,69 +263,242 @@ OpenManagement(connection_t *c)
 
 
 /*
- * Try to send a queued management command to OpenVPN
+ * Try to send queued management commands to OpenVPN. Responses are
+ * matched to commands in the order they were sent, so in pipelined
+ * mode all queued commands are written right away. Otherwise, and
+ * until the management interface is ready, only the head of the queue
+ * is sent and the next command is written when the response to it has
+ * been received.
  */
 static void
 SendCommand(connection_t *c)
 {
     int res;
     mgmt_cmd_t *cmd = c->manage.cmd_queue;
-    if (cmd == NULL || cmd->size == 0)
+    if (cmd == NULL)
         return;
 
-    res = send(c->manage.sk, cmd->command, cmd->size, 0);
-    if (res < 1)
-        return;
+    do
+    {
+        if (cmd->sent < cmd->size)
+        {
+            res = send(c->manage.sk, cmd->command + cmd->sent, cmd->size - cmd->sent, 0);
+            if (res < 1)
+                return;
+
+            cmd->sent += res;
+            if (cmd->sent < cmd->size)
+                return; /* continue on FD_WRITE */
+        }
+        cmd = cmd->next;
+    } while (o.mgmt_pipeline && c->manage.ready && cmd != c->manage.cmd_queue);
+}
 
-    if (res != cmd->size)
-        memmove(cmd->command, cmd->command + res, cmd->size - res);
 
-    cmd->size -= res;
+/* Max # of released command nodes kept per connection */
+static const unsigned int cmd_free_max = 16;
+
+/*
+ * Get a command node with room for size bytes of command, reusing a
+ * released node if possible
+ */
+static mgmt_cmd_t *
+AllocCommand(connection_t *c, int size)
+{
+    mgmt_cmd_t *cmd = c->manage.cmd_free;
+
+    if (cmd)
+    {
+        c->manage.cmd_free = cmd->next;
+        c->manage.cmd_free_count--;
+    }
+    else
+    {
+        cmd = malloc(sizeof(*cmd));
+        if (cmd == NULL)
+            return NULL;
+        c->manage.stats.allocs++;
+    }
+
+    cmd->command = cmd->buf;
+    if (size > MGMT_CMD_INLINE)
+    {
+        cmd->command = malloc(size);
+        if (cmd->command == NULL)
+        {
+            free(cmd);
+            return NULL;
+        }
+        c->manage.stats.allocs++;
+    }
+    cmd->prev = cmd->next = NULL;
+    cmd->size = size;
+    cmd->sent = 0;
+    return cmd;
 }
 
 
 /*
- * Send a command to the OpenVPN management interface
+ * Return a command node to the connection's free list. The command
+ * text must already have been wiped.
  */
-BOOL
-ManagementCommand(connection_t *c, char *command, mgmt_msg_func handler, mgmt_cmd_type type)
+static void
+ReleaseCommand(connection_t *c, mgmt_cmd_t *cmd)
 {
-    mgmt_cmd_t *cmd = calloc(1, sizeof(*cmd));
-    if (cmd == NULL)
-        return FALSE;
+    if (cmd->command != cmd->buf)
+        free(cmd->command);
+
+    if (c->manage.cmd_free_count >= cmd_free_max)
+    {
+        free(cmd);
+        return;
+    }
+    cmd->next = c->manage.cmd_free;
+    c->manage.cmd_free = cmd;
+    c->manage.cmd_free_count++;
+}
+
 
-    cmd->size = strlen(command) + 1;
-    cmd->command = malloc(cmd->size);
-    if (cmd->command == NULL)
+static void
+FreeCommandPool(connection_t *c)
+{
+    while (c->manage.cmd_free)
     {
+        mgmt_cmd_t *cmd = c->manage.cmd_free;
+        c->manage.cmd_free = cmd->next;
         free(cmd);
+    }
+    c->manage.cmd_free_count = 0;
+}
+
+
+/* A command queued on behalf of another thread, see QueueCommand */
+typedef struct {
+    connection_t *c;
+    char *command;
+    mgmt_msg_func handler;
+    mgmt_cmd_type type;
+    mgmt_cmd_prio prio;
+} mgmt_cmd_request_t;
+
+/* Max # of commands queued before further bulk commands are dropped */
+static const unsigned int cmd_queue_max = 64;
+
+/*
+ * Queue a command for the OpenVPN management interface. Bulk commands
+ * are appended to the queue. Interactive commands are inserted before
+ * the first bulk command that has not been sent yet, as responses are
+ * matched to sent commands in order.
+ */
+static BOOL
+QueueCommand(connection_t *c, char *command, mgmt_msg_func handler,
+             mgmt_cmd_type type, mgmt_cmd_prio prio)
+{
+    mgmt_cmd_t *cmd, *next;
+    BOOL late = FALSE;
+
+    /* Commands from other threads, such as a dialog shown off the shared
+     * status thread, are queued by the thread owning the connection */
+    if (GetCurrentThreadId() != c->threadId)
+    {
+        mgmt_cmd_request_t req = { c, command, handler, type, prio };
+        if (!c->hwndStatus)
+            return FALSE;
+        return (BOOL) SendMessage(c->hwndStatus, WM_MANAGEMENT_COMMAND, 0, (LPARAM) &req);
+    }
+
+    if (prio == bulk && c->manage.cmd_count >= cmd_queue_max)
+    {
+        c->manage.stats.dropped++;
+        PrintDebug(L"Management command queue full -- dropped: %.32S", command);
         return FALSE;
     }
+
+    cmd = AllocCommand(c, strlen(command) + 1);
+    if (cmd == NULL)
+        return FALSE;
+
     memcpy(cmd->command, command, cmd->size);
     *(cmd->command + cmd->size - 1) = '\n';
 
     cmd->handler = handler;
     cmd->type = type;
+    cmd->prio = prio;
 
     if (c->manage.cmd_queue)
     {
-        cmd->next = c->manage.cmd_queue;
-        cmd->prev = c->manage.cmd_queue->prev;
+        next = c->manage.cmd_queue;
+        if (prio == interactive)
+        {
+            while (next->sent || next->prio == interactive)
+            {
+                /* Has to wait for the response to a bulk command */
+                if (next->sent && next->prio == bulk)
+                    late = TRUE;
+                next = next->next;
+                if (next == c->manage.cmd_queue)
+                    break;
+            }
+        }
+
+        cmd->next = next;
+        cmd->prev = next->prev;
         cmd->next->prev = cmd->prev->next = cmd;
+
+        /* Jumped ahead of everything */
+        if (next == c->manage.cmd_queue && prio == interactive && next->sent == 0
+            && next->prio == bulk)
+            c->manage.cmd_queue = cmd;
     }
     else
     {
         cmd->next = cmd->prev = cmd;
         c->manage.cmd_queue = cmd;
     }
+    c->manage.cmd_count++;
+
+    if (late)
+        c->manage.stats.late++;
 
-    if (c->manage.cmd_queue == cmd)
+    if (c->manage.cmd_queue == cmd || (o.mgmt_pipeline && c->manage.ready))
         SendCommand(c);
 
     return TRUE;
 }
 
 
+/*
+ * Queue a command passed on by another thread in WM_MANAGEMENT_COMMAND
+ */
+BOOL
+OnManagementCommand(LPARAM lParam)
+{
+    mgmt_cmd_request_t *req = (mgmt_cmd_request_t *) lParam;
+    return QueueCommand(req->c, req->command, req->handler, req->type, req->prio);
+}
+
+
+/*
+ * Send a command to the OpenVPN management interface
+ */
+BOOL
+ManagementCommand(connection_t *c, char *command, mgmt_msg_func handler, mgmt_cmd_type type)
+{
+    return QueueCommand(c, command, handler, type, bulk);
+}
+
+
+/*
+ * Send a reply to a request of the OpenVPN management interface, such as
+ * a password or proxy setting. Replies take precedence over other commands.
+ */
+BOOL
+ManagementReply(connection_t *c, char *command, mgmt_msg_func handler, mgmt_cmd_type type)
+{
+    return QueueCommand(c, command, handler, type, interactive);
+}
+
+
 /*
  * Remove a command from a connection's command queue
  */
@@ -166,6 +518,7 @@ UnqueueCommand(connection_t *c)
         return TRUE;
     }
 
+    c->manage.cmd_count--;
     if (cmd->next == cmd)
     {
         c->manage.cmd_queue = NULL;
@@ -178,23 +531,190 @@ UnqueueCommand(connection_t *c)
         SendCommand(c);
     }
 
-    free(cmd->command);
-    free(cmd);
+    ReleaseCommand(c, cmd);
 
     return TRUE;
 }
 
 
+/*
+ * Release the receive buffer of a connection
+ */
+static void
+FreeRecvBuffer(connection_t *c)
+{
+    free(c->manage.rbuf.data);
+    CLEAR(c->manage.rbuf);
+}
+
+
+/*
+ * Read available management interface data into the receive buffer.
+ * Complete lines are consumed from the start of the buffer, so it is
+ * normally empty when new data arrives and the data is read to its
+ * beginning. A partial line is only moved to the front once the end of
+ * the buffer is reached, and the buffer only grows if a single line
+ * does not fit into it.
+ * Returns the number of bytes read or -1 on error.
+ */
+static int
+RecvManagement(connection_t *c)
+{
+    mgmt_rbuf_t *rb = &c->manage.rbuf;
+    ULONG data_size;
+    int res;
+
+    if (ioctlsocket(c->manage.sk, FIONREAD, &data_size) != 0
+    ||  data_size == 0)
+        return 0;
+
+    if (rb->data == NULL)
+    {
+        rb->data = malloc(rbuf_init_size);
+        if (rb->data == NULL)
+            return -1;
+        c->manage.stats.allocs++;
+        rb->size = rbuf_init_size;
+        rb->start = rb->end = 0;
+    }
+
+    /* While lines are dispatched the handlers point into the buffer */
+    if (rb->start == rb->end && !rb->busy)
+    {
+        rb->start = rb->end = 0;
+    }
+    else if (rb->end == rb->size)
+    {
+        if (rb->busy)
+        {
+            /* Read by the outermost invocation once the handlers return */
+            rb->pending = TRUE;
+            return 0;
+        }
+        else if (rb->start > 0)
+        {
+            memmove(rb->data, rb->data + rb->start, rb->end - rb->start);
+            rb->end -= rb->start;
+            rb->start = 0;
+        }
+        else if (rb->size < rbuf_max_size)
+        {
+            char *data = realloc(rb->data, rb->size * 2);
+            if (data == NULL)
+                return -1;
+            rb->data = data;
+            rb->size *= 2;
+            c->manage.stats.allocs++;
+        }
+        else
+        {
+            /* Discard an overlong line */
+            PrintDebug(L"Discarding management line longer than %lu bytes",
+                       (unsigned long) rbuf_max_size);
+            rb->start = rb->end = 0;
+        }
+    }
+
+    if (data_size > rb->size - rb->end)
+        data_size = rb->size - rb->end;
+
+    res = recv(c->manage.sk, rb->data + rb->end, data_size, 0);
+    if (res < 1)
+        return -1;
+
+    if (c->manage.record)
+        WriteRecord(c, rb->data + rb->end, res);
+
+    c->manage.stats.bytes += res;
+    rb->end += res;
+    return res;
+}
+
+
+/*
+ * Dispatch all complete lines in the receive buffer
+ */
+static void
+ParseManagement(connection_t *c)
+{
+    mgmt_rbuf_t *rb = &c->manage.rbuf;
+    mgmt_stats_t *stats = &c->manage.stats;
+    LARGE_INTEGER t0, t1;
+
+    while (rb->start < rb->end && c->manage.sk != INVALID_SOCKET)
+    {
+        char *pos;
+        char *line = rb->data + rb->start;
+        size_t line_size = rb->end - rb->start;
+
+        pos = memchr(line, (*c->manage.password ? ':' : '\n'), line_size);
+        if (pos == NULL)
+            break;
+
+        rb->start += (pos - line) + 1;
+
+        /* Reply to a management password request */
+        if (*c->manage.password)
+        {
+            ManagementReply(c, c->manage.password, NULL, regular);
+            *c->manage.password = '\0';
+            continue;
+        }
+
+        /* Handle regular management interface output */
+        *pos = '\0';
+        if (pos > line && *(pos - 1) == '\r')
+            *(pos - 1) = '\0';
+
+        stats->lines++;
+        QueryPerformanceCounter(&t0);
+
+        if (line[0] == '>')
+        {
+            /* Real time notifications */
+            DispatchRtmsg(c, line + 1);
+        }
+        else if (c->manage.cmd_queue)
+        {
+            /* Response to commands */
+            mgmt_cmd_t *cmd = c->manage.cmd_queue;
+            if (strncmp(line, "SUCCESS:", 8) == 0)
+            {
+                if (cmd->handler)
+                    cmd->handler(c, line + 9);
+                UnqueueCommand(c);
+            }
+            else if (strncmp(line, "ERROR:", 6) == 0)
+            {
+                if (cmd->handler)
+                    cmd->handler(c, NULL);
+                UnqueueCommand(c);
+            }
+            else if (strcmp(line, "END") == 0)
+            {
+                if (cmd->handler)
+                    cmd->handler(c, NULL);
+                UnqueueCommand(c);
+            }
+            else if (cmd->handler)
+            {
+                cmd->handler(c, line);
+            }
+        }
+
+        QueryPerformanceCounter(&t1);
+        stats->handler_time += t1.QuadPart - t0.QuadPart;
+        if (t1.QuadPart - t0.QuadPart > stats->handler_max)
+            stats->handler_max = t1.QuadPart - t0.QuadPart;
+    }
+}
+
 /*
  * Handle management socket events asynchronously
  */
 void
 OnManagement(SOCKET sk, LPARAM lParam)
 {
-    int res;
-    char *data;
-    ULONG data_size, offset;
-
     connection_t *c = GetConnByManagement(sk);
     if (c == NULL)
         return;
@@ -209,8 +729,7 @@ OnManagement(SOCKET sk, LPARAM lParam)
             else
             {
                 /* Connection to MI timed out. */
-                if (c->state != disconnected)
-                    c->state = timedout;
+                ConnStateEvent(c, ev_timeout, NULL);
                 CloseManagement (c);
                 rtmsg_handler[stop](c, "");
             }
@@ -220,141 +739,27 @@ OnManagement(SOCKET sk, LPARAM lParam)
         break;
 
     case FD_READ:
-        if (ioctlsocket(c->manage.sk, FIONREAD, &data_size) != 0
-        ||  data_size == 0)
-            return;
-
-        data = malloc(c->manage.saved_size + data_size);
-        if (data == NULL)
-            return;
-
-        res = recv(c->manage.sk, data + c->manage.saved_size, data_size, 0);
-        if (res != (int) data_size)
+        /*
+         * Handlers may run a nested message loop (e.g. a dialog box), so
+         * we can get here while lines are still dispatched from the buffer.
+         * New data is dispatched right away, the outer invocation then
+         * continues from the updated offsets. Only the outermost one may
+         * move the buffer, see RecvManagement.
+         */
+        do
         {
-            free(data);
-            return;
-        }
-
-        /* Copy previously saved management data */
-        if (c->manage.saved_size)
-        {
-            memcpy(data, c->manage.saved_data, c->manage.saved_size);
-            data_size += c->manage.saved_size;
-            free(c->manage.saved_data);
-            c->manage.saved_data = NULL;
-            c->manage.saved_size = 0;
-        }
-
-        offset = 0;
-        while (offset < data_size)
-        {
-            char *pos;
-            char *line = data + offset;
-            size_t line_size = data_size - offset;
-
-            pos = memchr(line, (*c->manage.password ? ':' : '\n'), line_size);
-            if (pos == NULL)
-            {
-                c->manage.saved_data = malloc(line_size);
-                if (c->manage.saved_data)
-                {
-                    c->manage.saved_size = line_size;
-                    memcpy(c->manage.saved_data, line, c->manage.saved_size);
-                }
+            c->manage.rbuf.pending = FALSE;
+            if (RecvManagement(c) < 0)
                 break;
-            }
-
-            offset += (pos - line) + 1;
-
-            /* Reply to a management password request */
-            if (*c->manage.password)
-            {
-                ManagementCommand(c, c->manage.password, NULL, regular);
-                *c->manage.password = '\0';
-                continue;
-            }
-
-            /* Handle regular management interface output */
-            line[pos - line - 1] = '\0';
-            if (line[0] == '>')
-            {
-                /* Real time notifications */
-                pos = line + 1;
-                if (strncmp(pos, "LOG:", 4) == 0)
-                {
-                    if (rtmsg_handler[log])
-                        rtmsg_handler[log](c, pos + 4);
-                }
-                else if (strncmp(pos, "STATE:", 6) == 0)
-                {
-                    if (rtmsg_handler[state])
-                        rtmsg_handler[state](c, pos + 6);
-                }
-                else if (strncmp(pos, "HOLD:", 5) == 0)
-                {
-                    if (rtmsg_handler[hold])
-                        rtmsg_handler[hold](c, pos + 5);
-                }
-                else if (strncmp(pos, "PASSWORD:", 9) == 0)
-                {
-                    if (rtmsg_handler[password])
-                        rtmsg_handler[password](c, pos + 9);
-                }
-                else if (strncmp(pos, "PROXY:", 6) == 0)
-                {
-                    if (rtmsg_handler[proxy])
-                        rtmsg_handler[proxy](c, pos + 6);
-                }
-                else if (strncmp(pos, "INFO:", 5) == 0)
-                {
-                    /* delay until management interface accepts input */
-                    Sleep(100);
-                    if (rtmsg_handler[ready])
-                        rtmsg_handler[ready](c, pos + 5);
-                }
-                else if (strncmp(pos, "NEED-OK:", 8) == 0)
-                {
-                    if (rtmsg_handler[needok])
-                        rtmsg_handler[needok](c, pos + 8);
-                }
-                else if (strncmp(pos, "NEED-STR:", 9) == 0)
-                {
-                    if (rtmsg_handler[needstr])
-                        rtmsg_handler[needstr](c, pos + 9);
-                }
-                else if (strncmp(pos, "ECHO:", 5) == 0)
-                {
-                    if (rtmsg_handler[echo])
-                        rtmsg_handler[echo](c, pos + 5);
-                }
-            }
-            else if (c->manage.cmd_queue)
-            {
-                /* Response to commands */
-                mgmt_cmd_t *cmd = c->manage.cmd_queue;
-                if (strncmp(line, "SUCCESS:", 8) == 0)
-                {
-                    if (cmd->handler)
-                        cmd->handler(c, line + 9);
-                    UnqueueCommand(c);
-                }
-                else if (strncmp(line, "ERROR:", 6) == 0)
-                {
-                    if (cmd->handler)
-                        cmd->handler(c, NULL);
-                    UnqueueCommand(c);
-                }
-                else if (strcmp(line, "END") == 0)
-                {
-                    UnqueueCommand(c);
-                }
-                else if (cmd->handler)
-                {
-                    cmd->handler(c, line);
-                }
-            }
-        }
-        free(data);
+            c->manage.rbuf.busy++;
+            ParseManagement(c);
+            c->manage.rbuf.busy--;
+        } while (c->manage.rbuf.busy == 0 && c->manage.rbuf.pending
+                 && c->manage.sk != INVALID_SOCKET);
+
+        /* Management got closed by one of the handlers */
+        if (c->manage.sk == INVALID_SOCKET && c->manage.rbuf.busy == 0)
+            FreeRecvBuffer(c);
         break;
 
     case FD_WRITE:
@@ -374,17 +779,17 @@ CloseManagement(connection_t *c)
 {
     if (c->manage.sk != INVALID_SOCKET)
     {
-        if (c->manage.saved_size)
-        {
-            free(c->manage.saved_data);
-            c->manage.saved_data = NULL;
-            c->manage.saved_size = 0;
-        }
+        if (!c->manage.rbuf.busy)
+            FreeRecvBuffer(c);
+        UnmapConnManagement(c);
+        CloseRecord(c);
         closesocket(c->manage.sk);
         c->manage.sk = INVALID_SOCKET;
         c->manage.connected = FALSE;
+        c->manage.ready = FALSE;
         while (UnqueueCommand(c))
             ;
+        FreeCommandPool(c);
         WSACleanup();
     }
 }
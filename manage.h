@@ -25,6 +25,7 @@
 #include <winsock2.h>
 
 #define WM_MANAGEMENT (WM_APP + 2)
+#define WM_MANAGEMENT_COMMAND (WM_APP + 3)
 
 typedef enum {
     ready,
@@ -47,6 +48,15 @@ typedef enum {
     combined
 } mgmt_cmd_type;
 
+/*
+ * Interactive commands answer a request of OpenVPN and are sent ahead
+ * of any bulk commands that have not been sent yet
+ */
+typedef enum {
+    bulk,
+    interactive
+} mgmt_cmd_prio;
+
 typedef void (*mgmt_msg_func)(connection_t *, char *);
 
 typedef struct {
@@ -54,18 +64,53 @@ typedef struct {
     mgmt_msg_func handler;
 } mgmt_rtmsg_handler;
 
+/*
+ * Receive buffer for management interface output. Data is appended at
+ * end and complete lines are consumed in place from start.
+ */
+typedef struct {
+    char *data;
+    size_t size;        /* allocated size of data */
+    size_t start;       /* offset of the first unparsed byte */
+    size_t end;         /* offset past the last received byte */
+    int busy;           /* depth of dispatching lines from the buffer */
+    BOOL pending;       /* data left unread as the buffer could not move */
+} mgmt_rbuf_t;
+
+/*
+ * Counters of management interface activity, summarized when the
+ * management interface is closed
+ */
+typedef struct {
+    ULONGLONG bytes;        /* # of bytes received */
+    ULONGLONG lines;        /* # of lines dispatched */
+    unsigned int allocs;    /* # of receive buffer and command allocations */
+    LONGLONG handler_time;  /* time spent dispatching lines in performance counter ticks */
+    LONGLONG handler_max;   /* longest time spent on a single line */
+    unsigned int dropped;   /* # of bulk commands dropped as the queue was full */
+    unsigned int late;      /* # of interactive commands queued behind sent bulk commands */
+} mgmt_stats_t;
+
+/* Commands up to this size are stored in the command node itself */
+#define MGMT_CMD_INLINE 200
+
 typedef struct mgmt_cmd {
     struct mgmt_cmd *prev, *next;
-    char *command;
+    char *command;          /* points to buf unless the command is longer */
     int size;
+    int sent;               /* # of bytes already written to the socket */
     mgmt_msg_func handler;
     mgmt_cmd_type type;
+    mgmt_cmd_prio prio;
+    char buf[MGMT_CMD_INLINE];
 } mgmt_cmd_t;
 
 
 void InitManagement(const mgmt_rtmsg_handler *handler);
 BOOL OpenManagement(connection_t *);
 BOOL ManagementCommand(connection_t *, char *, mgmt_msg_func, mgmt_cmd_type);
+BOOL OnManagementCommand(LPARAM);
+BOOL ManagementReply(connection_t *, char *, mgmt_msg_func, mgmt_cmd_type);
 
 void OnManagement(SOCKET, LPARAM);
 void CloseManagement(connection_t *);
@@ -0,0 +1,441 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Stand-in for the management interface of OpenVPN that replays a
+ * transcript recorded with the management_record option.
+ *
+ * It listens on the management address given on the command line, like
+ * OpenVPN does, and sends the recorded data to the first client that
+ * connects, at the original pace or faster. Responses to commands are
+ * held back until the client has sent as many commands, so that they are
+ * matched as in the recording. At the end the rate achieved and the time
+ * the client took to send its commands are reported.
+ *
+ * Standalone, e.g. on Linux:
+ *   mgmt-replay --replay client.mgmt --speed 0 --management 127.0.0.1 25340
+ *
+ * In place of openvpn.exe, with exe_path pointing to it, the transcript
+ * is taken from MGMT_REPLAY and the speed from MGMT_REPLAY_SPEED. All
+ * other OpenVPN options are ignored.
+ *
+ * Builds with any C99 compiler on Windows or POSIX systems.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+typedef int socklen_t;
+#define close_socket closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <time.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define close_socket close
+#endif
+
+/* Max time to wait for a command a response is held back for, in ms */
+#define COMMAND_TIMEOUT 5000
+
+/* A chunk of data as received by the GUI */
+typedef struct {
+    unsigned long time;         /* ms since the start of the recording */
+    const char *data;
+    size_t size;
+    unsigned int lines;
+    unsigned int responses;     /* # of command responses completed in it */
+} chunk_t;
+
+typedef struct {
+    SOCKET sk;
+    char buf[1024];
+    size_t len;                 /* # of bytes of an incomplete command in buf */
+    unsigned int commands;      /* # of commands received */
+    int verbose;
+    int closed;
+} client_t;
+
+static unsigned long long
+now_ms(void)
+{
+#ifdef _WIN32
+    return GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static char *
+read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    char *data = NULL;
+    long len;
+
+    if (!f)
+        return NULL;
+    if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0
+        && (data = malloc(len + 1)) != NULL)
+    {
+        *size = fread(data, 1, len, f);
+        data[*size] = '\0';
+    }
+    fclose(f);
+    return data;
+}
+
+/* Kinds of lines ending a response to a command */
+enum {
+    not_response,
+    response_end,               /* END */
+    response_status             /* SUCCESS: or ERROR: */
+};
+
+static int
+is_response(const char *line, size_t len)
+{
+    if ((len >= 8 && strncmp(line, "SUCCESS:", 8) == 0)
+        || (len >= 6 && strncmp(line, "ERROR:", 6) == 0))
+        return response_status;
+    if (len >= 3 && strncmp(line, "END", 3) == 0 && (len == 3 || line[3] == '\r'))
+        return response_end;
+    return not_response;
+}
+
+/*
+ * Split a transcript into its chunks. Returns the # of chunks or -1 if
+ * the file is malformed.
+ */
+static int
+parse_transcript(const char *data, size_t size, chunk_t **chunks)
+{
+    const char *p = data, *end = data + size;
+    int n = 0, max = 0, after_end = 0;
+
+    *chunks = NULL;
+    while (p < end)
+    {
+        const char *eol = memchr(p, '\n', end - p);
+        unsigned long time, len;
+        chunk_t *ch;
+
+        if (!eol)
+            eol = end;
+        if (*p == '#' || p == eol)
+        {
+            p = eol + 1;
+            continue;
+        }
+        if (sscanf(p, "@%lu %lu", &time, &len) != 2 || len > (unsigned long) (end - eol - 1))
+            return -1;
+
+        if (n == max)
+        {
+            chunk_t *tmp = realloc(*chunks, (max = max ? 2 * max : 256) * sizeof(chunk_t));
+            if (!tmp)
+                return -1;
+            *chunks = tmp;
+        }
+        ch = &(*chunks)[n++];
+        ch->time = time;
+        ch->data = eol + 1;
+        ch->size = len;
+        ch->lines = ch->responses = 0;
+
+        /*
+         * Count lines and responses, lines may be split over chunks.
+         * Combined commands like "log all on" are answered by END and
+         * then SUCCESS, which count as one response. Real time
+         * notifications may come in between.
+         */
+        const char *line = ch->data, *stop = ch->data + len;
+        while (line < stop)
+        {
+            const char *nl = memchr(line, '\n', stop - line);
+            if (!nl)
+                break;
+            ch->lines++;
+            switch (is_response(line, nl - line))
+            {
+            case response_end:
+                ch->responses++;
+                after_end = 1;
+                break;
+            case response_status:
+                if (!after_end)
+                    ch->responses++;
+                after_end = 0;
+                break;
+            default:
+                if (*line != '>')
+                    after_end = 0;
+            }
+            line = nl + 1;
+        }
+        p = ch->data + len + 1;
+    }
+    return n;
+}
+
+/*
+ * Read commands from the client for up to timeout ms, or until there
+ * is nothing more to read if timeout is 0
+ */
+static void
+read_commands(client_t *cl, unsigned long timeout)
+{
+    unsigned long long deadline = now_ms() + timeout;
+
+    while (!cl->closed)
+    {
+        struct timeval tv;
+        fd_set fds;
+        unsigned long long now = now_ms();
+        unsigned long left = now < deadline ? (unsigned long) (deadline - now) : 0;
+        int res;
+
+        FD_ZERO(&fds);
+        FD_SET(cl->sk, &fds);
+        tv.tv_sec = left / 1000;
+        tv.tv_usec = (left % 1000) * 1000;
+        if (select((int) cl->sk + 1, &fds, NULL, NULL, &tv) < 1)
+            return;
+
+        res = recv(cl->sk, cl->buf + cl->len, sizeof(cl->buf) - cl->len, 0);
+        if (res < 1)
+        {
+            cl->closed = 1;
+            return;
+        }
+        cl->len += res;
+
+        char *line = cl->buf, *nl;
+        while ((nl = memchr(line, '\n', cl->buf + cl->len - line)) != NULL)
+        {
+            cl->commands++;
+            if (cl->verbose)
+            {
+                int hide = strncmp(line, "password ", 9) == 0 || strncmp(line, "username ", 9) == 0
+                           || cl->commands == 1;
+                fprintf(stderr, "< %.*s\n", hide ? 8 : (int) (nl - line), hide ? "[hidden]" : line);
+            }
+            line = nl + 1;
+        }
+        cl->len -= line - cl->buf;
+        memmove(cl->buf, line, cl->len);
+
+        /* Overlong command: count it when its end arrives */
+        if (cl->len == sizeof(cl->buf))
+            cl->len = 0;
+
+        /* Only wait until something arrived */
+        if (timeout)
+            return;
+    }
+}
+
+static SOCKET
+accept_client(const char *addr, unsigned short port)
+{
+    struct sockaddr_in sa;
+    SOCKET lsk, sk;
+    int on = 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = inet_addr(addr);
+
+    lsk = socket(AF_INET, SOCK_STREAM, 0);
+    if (lsk == INVALID_SOCKET)
+        return INVALID_SOCKET;
+    setsockopt(lsk, SOL_SOCKET, SO_REUSEADDR, (const char *) &on, sizeof(on));
+    if (bind(lsk, (struct sockaddr *) &sa, sizeof(sa)) != 0 || listen(lsk, 1) != 0)
+    {
+        close_socket(lsk);
+        return INVALID_SOCKET;
+    }
+    sk = accept(lsk, NULL, NULL);
+    close_socket(lsk);
+    return sk;
+}
+
+static int
+send_all(SOCKET sk, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        int res = send(sk, data, size > 65536 ? 65536 : (int) size, 0);
+        if (res < 1)
+            return 0;
+        data += res;
+        size -= res;
+    }
+    return 1;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: mgmt-replay --replay <transcript> [--speed <factor>] [--verbose]\n"
+                    "                   --management <address> <port> [stdin]\n"
+                    "A speed of 0 replays without delays, the default is 1.\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *path = getenv("MGMT_REPLAY");
+    const char *addr = NULL;
+    double speed = getenv("MGMT_REPLAY_SPEED") ? atof(getenv("MGMT_REPLAY_SPEED")) : 1.0;
+    unsigned short port = 0;
+    int i, n, pw_stdin = 0;
+    client_t cl;
+    chunk_t *chunks;
+    char *data;
+    size_t size;
+
+    memset(&cl, 0, sizeof(cl));
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            path = argv[++i];
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+            speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--verbose") == 0)
+            cl.verbose = 1;
+        else if (strcmp(argv[i], "--management") == 0 && i + 2 < argc)
+        {
+            addr = argv[++i];
+            port = (unsigned short) atoi(argv[++i]);
+            if (i + 1 < argc && strcmp(argv[i + 1], "stdin") == 0)
+            {
+                pw_stdin = 1;
+                ++i;
+            }
+        }
+    }
+    if (!path || !addr || !port || speed < 0)
+    {
+        usage();
+        return 1;
+    }
+
+    /* The management password is checked by the client's replayed responses */
+    if (pw_stdin)
+    {
+        char pw[256];
+        if (!fgets(pw, sizeof(pw), stdin))
+            pw[0] = '\0';
+    }
+
+    data = read_file(path, &size);
+    if (!data)
+    {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return 1;
+    }
+    n = parse_transcript(data, size, &chunks);
+    if (n < 0)
+    {
+        fprintf(stderr, "%s is not a management interface transcript\n", path);
+        return 1;
+    }
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+        return 1;
+#endif
+
+    cl.sk = accept_client(addr, port);
+    if (cl.sk == INVALID_SOCKET)
+    {
+        fprintf(stderr, "Cannot listen on %s:%hu\n", addr, port);
+        return 1;
+    }
+
+    unsigned long long start = now_ms(), wait_total = 0;
+    unsigned long wait_max = 0, bytes = 0, lines = 0;
+    unsigned int responses = 0, waits = 0, timeouts = 0;
+
+    for (i = 0; i < n && !cl.closed; i++)
+    {
+        chunk_t *ch = &chunks[i];
+
+        /* Keep the original pace, scaled by speed */
+        if (speed > 0)
+        {
+            unsigned long long due = start + (unsigned long long) (ch->time / speed);
+            while (!cl.closed && now_ms() < due)
+                read_commands(&cl, (unsigned long) (due - now_ms()));
+        }
+        read_commands(&cl, 0);
+
+        /* Hold back responses until the commands they answer are in */
+        if (cl.commands < responses + ch->responses)
+        {
+            unsigned long long t0 = now_ms(), t;
+            while (!cl.closed && cl.commands < responses + ch->responses
+                   && (t = now_ms()) - t0 < COMMAND_TIMEOUT)
+                read_commands(&cl, COMMAND_TIMEOUT - (unsigned long) (t - t0));
+
+            t = now_ms() - t0;
+            waits++;
+            wait_total += t;
+            if (t > wait_max)
+                wait_max = (unsigned long) t;
+            if (cl.commands < responses + ch->responses)
+                timeouts++;
+        }
+
+        if (!send_all(cl.sk, ch->data, ch->size))
+            break;
+        responses += ch->responses;
+        bytes += ch->size;
+        lines += ch->lines;
+    }
+
+    /* Give the client a moment to send its last commands */
+    read_commands(&cl, 200);
+
+    double secs = (now_ms() - start) / 1000.0;
+    fprintf(stderr, "replayed %d/%d chunks, %lu lines, %lu bytes in %.3f s (%.0f lines/s)\n",
+            i, n, lines, bytes, secs, secs > 0 ? lines / secs : 0.0);
+    fprintf(stderr, "commands=%u responses=%u command wait avg=%.1f ms max=%lu ms timeouts=%u\n",
+            cl.commands, responses, waits ? (double) wait_total / waits : 0.0, wait_max, timeouts);
+
+    close_socket(cl.sk);
+    free(chunks);
+    free(data);
+    return i == n ? 0 : 2;
+}
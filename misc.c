@@ -199,7 +199,7 @@ ManagementCommandFromInput(connection_t *c, LPCSTR fmt, HWND hDlg, int id)
     if (cmd)
     {
         snprintf(cmd, cmd_len, fmt, input);
-        retval = ManagementCommand(c, cmd, NULL, regular);
+        retval = ManagementReply(c, cmd, NULL, regular);
         free(cmd);
     }
 
@@ -273,7 +273,7 @@ ManagementCommandFromInputBase64(connection_t *c, LPCSTR fmt, HWND hDlg,int id,
     if (cmd)
     {
         snprintf(cmd, cmd_len, fmt, input_b64, input2_b64);
-        retval = ManagementCommand(c, cmd, NULL, regular);
+        retval = ManagementReply(c, cmd, NULL, regular);
         free(cmd);
     }
 
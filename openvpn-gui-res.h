@@ -42,6 +42,8 @@
 #define ID_DISCONNECT                    163
 #define ID_RESTART                       164
 #define ID_HIDE                          165
+#define ID_TXT_BYTECOUNT                 166
+#define ID_EDT_LOG_FIND                  167
 
 /* Change Passphrase Dialog */
 #define ID_DLG_CHGPASS                   170
@@ -119,6 +121,29 @@
 /* Connections dialog */
 #define ID_DLG_CONNECTIONS               290
 
+/* Log viewer dialog */
+#define ID_DLG_LOGVIEW                   300
+#define ID_LST_LOGVIEW                   301
+#define ID_CHK_LOGVIEW_FOLLOW            302
+#define ID_CHK_LOGVIEW_INFO              303
+#define ID_CHK_LOGVIEW_WARN              304
+#define ID_CHK_LOGVIEW_NONFATAL          305
+#define ID_CHK_LOGVIEW_FATAL             306
+#define ID_CHK_LOGVIEW_DEBUG             307
+#define ID_TXT_LOGVIEW_LINE              308
+#define ID_EDT_LOGVIEW_LINE              309
+#define ID_BTN_LOGVIEW_GOTO              310
+#define ID_TXT_LOGVIEW_STATUS            311
+#define ID_TXT_LOGVIEW_FIND              312
+#define ID_EDT_LOGVIEW_FIND              313
+#define ID_BTN_LOGVIEW_FIND              314
+
+/* Log timeline dialog */
+#define ID_DLG_TIMELINE                  320
+#define ID_LST_TIMELINE                  321
+#define ID_TXT_TIMELINE_STATUS           322
+#define ID_BTN_TIMELINE_REFRESH          323
+
 /*
  * String Table Resources
  */
@@ -129,6 +154,7 @@
 #define IDS_TIP_CONNECTING              1003
 #define IDS_TIP_CONNECTED_SINCE         1004
 #define IDS_TIP_ASSIGNED_IP             1005
+#define IDS_TIP_BYTECOUNT               1002
 
 /* Tray Icon Context Menu */
 #define IDS_MENU_SERVICE                1006
@@ -149,6 +175,7 @@
 #define IDS_MENU_ASK_STOP_SERVICE       1022
 #define IDS_MENU_IMPORT                 1023
 #define IDS_MENU_CLEARPASS              1024
+#define IDS_MENU_TIMELINE               1025
 
 /* LogViewer Dialog */
 #define IDS_ERR_START_LOG_VIEWER        1101
@@ -204,10 +231,29 @@
 #define IDS_ERR_CONFIG_TRY_AUTHORIZE    1255
 #define IDS_NFO_CONFIG_AUTH_PENDING     1256
 #define IDS_ERR_ADD_USER_TO_ADMIN_GROUP 1257
+#define IDS_NFO_BYTECOUNT               1258
+#define IDS_NFO_LOGVIEW_TITLE           1259
+#define IDS_NFO_LOGVIEW_LINES           1260
+#define IDS_NFO_LOGVIEW_FILTERED        1261
+#define IDS_ERR_LOGVIEW_OPEN            1262
+#define IDS_NFO_LOG_FIND                1263
+#define IDS_NFO_LOG_NOT_FOUND           1264
+#define IDS_NFO_TIMELINE_LINES          1265
+#define IDS_NFO_TIMELINE_MERGING        1266
+#define IDS_NFO_TIMELINE_TIME           1267
+#define IDS_NFO_TIMELINE_CONNECTION     1268
+#define IDS_NFO_TIMELINE_MESSAGE        1269
+#define IDS_NFO_LOG_REPEATED            1270
+#define IDS_NFO_LOG_RATE_LIMITED        1271
+#define IDS_NFO_CONNECT_TIME            1272
+#define IDS_NFO_CONNECT_PERCENTILES     1273
+#define IDS_NFO_CONNECT_PHASE_P95       1274
+#define IDS_NFO_AUTOSTART_DONE_TITLE    1275
+#define IDS_NFO_AUTOSTART_DONE          1276
+#define IDS_NFO_RESUME_DONE             1277
 
 /* Program Startup Related */
 #define IDS_ERR_OPEN_DEBUG_FILE         1301
-#define IDS_ERR_LOAD_RICHED20           1302
 #define IDS_ERR_SHELL_DLL_VERSION       1303
 #define IDS_ERR_GUI_ALREADY_RUNNING     1304
 #define IDS_NFO_SERVICE_STARTED         1305
@@ -312,5 +358,7 @@
 
 /* Timer IDs */
 #define IDT_STOP_TIMER                  2500  /* Timer used to trigger force termination */
+#define IDT_LOG_TIMER                   2501  /* Timer used to update the log window */
+#define IDT_RESUME_TIMER                2502  /* Timer used to restart the next suspended connection */
 
 #endif
@@ -31,7 +31,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <process.h>
-#include <richedit.h>
+#include <commctrl.h>
 #include <time.h>
 
 #include "tray.h"
@@ -46,14 +46,31 @@
 #include "passphrase.h"
 #include "localization.h"
 #include "misc.h"
+#include "log_time.h"
 #include "access.h"
 #include "save_pass.h"
+#include "autostart.h"
+#include "resume.h"
+#include "shutdown.h"
 
 #define WM_OVPN_STOP    (WM_APP + 10)
 #define WM_OVPN_SUSPEND (WM_APP + 11)
+#define WM_OVPN_START   (WM_APP + 12)
+#define WM_OVPN_RELEASE (WM_APP + 13)
+#define WM_OVPN_STOPPED (WM_APP + 14)
+#define WM_OVPN_LOG     (WM_APP + 15)
+
+/* Max # of connections handled by the shared status thread */
+#define SHARED_STATUS_MAX (MAXIMUM_WAIT_OBJECTS - 1)
 
 extern options_t o;
 
+/* Thread serving the status windows of connections if shared_status_thread is set */
+static struct {
+    DWORD id;
+    volatile LONG count;    /* # of connections assigned to the thread */
+} shared_status;
+
 static BOOL
 TerminateOpenVPN(connection_t *c);
 
@@ -76,7 +93,17 @@ typedef struct {
 } auth_param_t;
 
 static void
-WriteStatusLog (connection_t *c, const WCHAR *prefix, const WCHAR *line, BOOL fileio);
+QueueStatusLog (connection_t *c, time_t timestamp, WORD flags, const WCHAR *prefix,
+                const WCHAR *line);
+
+static void
+ScheduleStatusLog (connection_t *c);
+
+static void
+FlushStatusLog (connection_t *c);
+
+static ULONGLONG
+HashStatusLog (WORD flags, const WCHAR *prefix, const WCHAR *line);
 
 static void
 free_auth_param (auth_param_t *param)
@@ -89,6 +116,136 @@ free_auth_param (auth_param_t *param)
     free (param);
 }
 
+/* Blocking work of a connection, such as a script or a modal dialog */
+typedef void (*status_job_func)(connection_t *c, LPARAM arg);
+
+typedef struct {
+    connection_t *c;
+    status_job_func fn;
+    LPARAM arg;
+    HWND hwnd;              /* status window the job was started for */
+    UINT done;              /* message sent to that window when done, or 0 */
+    WPARAM wParam;
+} status_job_t;
+
+static DWORD WINAPI
+ThreadStatusJob(void *p)
+{
+    status_job_t *job = p;
+
+    job->fn(job->c, job->arg);
+    if (job->done && job->hwnd)
+        PostMessage(job->hwnd, job->done, job->wParam, 0);
+    free(job);
+    return 0;
+}
+
+/*
+ * Run blocking work of a connection. On the shared status thread it gets
+ * a thread of its own, as it would stall all other connections otherwise.
+ * Elsewhere, or if no thread can be started, it is run right here. Either
+ * way message done, unless 0, is sent afterwards to the status window
+ * the job was started for, never to that of a later session.
+ */
+static void
+RunStatusJob(connection_t *c, status_job_func fn, LPARAM arg, UINT done, WPARAM wParam)
+{
+    HWND hwnd = c->hwndStatus;
+    status_job_t *job;
+    HANDLE thread;
+
+    if (GetCurrentThreadId() == shared_status.id && (job = malloc(sizeof(*job))) != NULL)
+    {
+        job->c = c;
+        job->fn = fn;
+        job->arg = arg;
+        job->hwnd = hwnd;
+        job->done = done;
+        job->wParam = wParam;
+        thread = CreateThread(NULL, 0, ThreadStatusJob, job, 0, NULL);
+        if (thread)
+        {
+            CloseHandle(thread);
+            return;
+        }
+        free(job);
+    }
+
+    fn(c, arg);
+    if (done && IsWindow(hwnd))
+        SendMessage(hwnd, done, wParam, 0);
+}
+
+typedef struct {
+    UINT id;
+    DLGPROC proc;
+    LPARAM param;
+} status_dialog_t;
+
+static void
+DialogJob(UNUSED connection_t *c, LPARAM arg)
+{
+    status_dialog_t *dlg = (status_dialog_t *) arg;
+
+    LocalizedDialogBoxParam(dlg->id, dlg->proc, dlg->param);
+    free(dlg);
+}
+
+/*
+ * Show a modal dialog for a connection, see RunStatusJob
+ */
+void
+StatusDialogBox(connection_t *c, UINT id, DLGPROC proc, LPARAM param)
+{
+    status_dialog_t *dlg = malloc(sizeof(*dlg));
+
+    if (!dlg)
+    {
+        LocalizedDialogBoxParam(id, proc, param);
+        return;
+    }
+    dlg->id = id;
+    dlg->proc = proc;
+    dlg->param = param;
+    RunStatusJob(c, DialogJob, (LPARAM) dlg, 0, 0);
+}
+
+static void
+MessageJob(connection_t *c, LPARAM arg)
+{
+    MessageBox(c->hwndStatus, (WCHAR *) arg, _T(PACKAGE_NAME), MB_OK);
+    free((WCHAR *) arg);
+}
+
+/*
+ * Show a message box for a connection and close its status window
+ * once it is dismissed
+ */
+static void
+StatusMessageAndClose(connection_t *c, const WCHAR *msg)
+{
+    WCHAR *text = _wcsdup(msg);
+
+    if (!text)
+    {
+        SendMessage(c->hwndStatus, WM_CLOSE, 0, 0);
+        return;
+    }
+    RunStatusJob(c, MessageJob, (LPARAM) text, WM_CLOSE, 0);
+}
+
+static void
+ConnectScriptJob(connection_t *c, UNUSED LPARAM arg)
+{
+    RunConnectScript(c, false);
+}
+
+static void
+DisconnectScriptJob(connection_t *c, UNUSED LPARAM arg)
+{
+    RunDisconnectScript(c, false);
+}
+
 void
 AppendTextToCaption (HANDLE hwnd, const WCHAR *str)
 {
@@ -107,8 +264,37 @@ void
 OnReady(connection_t *c, UNUSED char *msg)
 {
     ManagementCommand(c, "state on", NULL, regular);
-    ManagementCommand(c, "log all on", OnLogLine, combined);
+    if (o.log_backfill)
+    {
+        /* Bounded history and real time lines in one command, so that
+         * no line is lost in between. The history ends with END. */
+        char cmd[32];
+        WCHAR last[MAX_LOG_LENGTH];
+        ULONGLONG first, next, n;
+        log_record_t rec;
+
+        /* The last restored line of OpenVPN marks where the history is new */
+        c->log_view.history_since = 0;
+        c->log_view.history_hash = 0;
+        LogModelRange(&c->log, &first, &next);
+        for (n = next; n > first && next - n < 64; --n)
+        {
+            if (!LogModelGet(&c->log, n - 1, &rec, last, _countof(last)))
+                break;
+            if (rec.flags & LOG_FLAG_GUI)
+                continue;
+            c->log_view.history_since = rec.timestamp;
+            c->log_view.history_hash = HashStatusLog(rec.flags, L"", last);
+            break;
+        }
+
+        _snprintf_0(cmd, "log %lu on", o.log_backfill);
+        ManagementCommand(c, cmd, OnLogHistory, combined);
+    }
+    else
+        ManagementCommand(c, "log all on", OnLogLine, combined);
     ManagementCommand(c, "echo all on", OnEcho, combined);
+    ManagementCommand(c, "bytecount 1", NULL, regular);
 }
 
 
@@ -122,6 +308,34 @@ OnHold(connection_t *c, UNUSED char *msg)
     ManagementCommand(c, "hold release", NULL, regular);
 }
 
+/*
+ * Split a log line of the OpenVPN management interface
+ * Format <TIMESTAMP>,<FLAGS>,<MESSAGE>
+ * Returns the message converted to UTF-16 in buf, or allocated if it
+ * does not fit, or NULL on error.
+ */
+static WCHAR *
+ParseLogLine(char *line, time_t *timestamp, WORD *flags, WCHAR *buf, size_t size)
+{
+    char *pflags, *message;
+
+    pflags = strchr(line, ',') + 1;
+    if (pflags - 1 == NULL)
+        return NULL;
+
+    message = strchr(pflags, ',') + 1;
+    if (message - 1 == NULL)
+        return NULL;
+    size_t flag_size = message - pflags - 1; /* message is always > flags */
+
+    *timestamp = strtol(line, NULL, 10);
+    *flags = LogModelParseFlags(pflags, flag_size);
+
+    if (MultiByteToWideChar(CP_UTF8, 0, message, -1, buf, size) == 0)
+        return Widen(message);
+    return buf;
+}
+
 /*
  * Handle a log line from the OpenVPN management interface
  * Format <TIMESTAMP>,<FLAGS>,<MESSAGE>
@@ -129,63 +343,198 @@ OnHold(connection_t *c, UNUSED char *msg)
 void
 OnLogLine(connection_t *c, char *line)
 {
-    HWND logWnd = GetDlgItem(c->hwndStatus, ID_EDT_LOG);
-    char *flags, *message;
     time_t timestamp;
-    TCHAR *datetime;
-    const SETTEXTEX ste = {
-        .flags = ST_SELECTION,
-        .codepage = CP_UTF8
-    };
+    WORD flags;
+    WCHAR buf[MAX_LOG_LENGTH];
+    WCHAR *wmessage;
 
-    flags = strchr(line, ',') + 1;
-    if (flags - 1 == NULL)
+    if (line == NULL)
         return;
 
-    message = strchr(flags, ',') + 1;
-    if (message - 1 == NULL)
+    wmessage = ParseLogLine(line, &timestamp, &flags, buf, _countof(buf));
+    if (wmessage == NULL)
+        return;
+
+    QueueStatusLog(c, timestamp, flags, L"", wmessage);
+
+    if (wmessage != buf)
+        free(wmessage);
+}
+
+/*
+ * Handle a line of the log history requested in OnReady. Lines go
+ * straight to the journal and the log model, skipping the filters and
+ * lines already restored from the journal: those before the last
+ * restored line, which is found by its time and hash. The status
+ * window is updated once at the end of the history (line is NULL).
+ * The SUCCESS text of the command is no log line and is ignored.
+ */
+void
+OnLogHistory(connection_t *c, char *line)
+{
+    time_t timestamp;
+    WORD flags;
+    WCHAR buf[MAX_LOG_LENGTH];
+    WCHAR *wmessage;
+
+    if (line == NULL)
+    {
+        if (c->hwndStatus)
+            ScheduleStatusLog(c);
+        return;
+    }
+    if (!c->hwndStatus)
+        return;
+
+    wmessage = ParseLogLine(line, &timestamp, &flags, buf, _countof(buf));
+    if (wmessage == NULL)
         return;
-    size_t flag_size = message - flags - 1; /* message is always > flags */
 
-    /* Remove lines from log window if it is getting full */
-    if (SendMessage(logWnd, EM_GETLINECOUNT, 0, 0) > MAX_LOG_LINES)
+    if (timestamp > c->log_view.history_since
+        || (timestamp == c->log_view.history_since && !c->log_view.history_hash))
+    {
+        WriteJournal(&c->journal, timestamp, flags, L"", wmessage);
+        LogModelAdd(&c->log, timestamp, flags, L"", wmessage);
+    }
+    else if (timestamp == c->log_view.history_since
+             && HashStatusLog(flags, L"", wmessage) == c->log_view.history_hash)
     {
-        int pos = SendMessage(logWnd, EM_LINEINDEX, DEL_LOG_LINES, 0);
-        SendMessage(logWnd, EM_SETSEL, 0, pos);
-        SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) _T(""));
+        /* Lines of the same second after this one are new */
+        c->log_view.history_hash = 0;
     }
 
-    timestamp = strtol(line, NULL, 10);
-    datetime = _tctime(&timestamp);
-    datetime[24] = _T(' ');
+    if (wmessage != buf)
+        free(wmessage);
+}
+
 
-    /* deselect current selection, if any */
-    SendMessage(logWnd, EM_SETSEL, (WPARAM) -1, (LPARAM) -1);
+/*
+ * Append the time taken by each phase of the last attempt, in ms, to
+ * <config>.connect.csv in the log directory
+ */
+static void
+WriteConnectTimes (connection_t *c, DWORD total)
+{
+    connect_stats_t *cs = &c->connect_stats;
+    WCHAR path[MAX_PATH], line[512], *p;
+    SYSTEMTIME st;
+    log_file_t *f;
+    size_t len;
+    int i, n;
+
+    _tcsncpy(path, c->log_path, _countof(path) - 1);
+    path[_countof(path) - 1] = L'\0';
+    p = wcsrchr(path, L'.');
+    if (p == NULL || (size_t) (p - path) + 13 >= _countof(path))
+        return;
+    wcscpy(p, L".connect.csv");
 
-    /* change text color if Warning or Error */
-    COLORREF text_clr = 0;
+    f = OpenLogFile(path, 0);
+    if (f == NULL)
+        return;
 
-    if (memchr(flags, 'N', flag_size) || memchr(flags, 'F', flag_size))
-        text_clr = o.clr_error;
-    else if (memchr(flags, 'W', flag_size))
-        text_clr = o.clr_warning;
+    if (GetFileAttributes(path) == INVALID_FILE_ATTRIBUTES)
+    {
+        len = wcslen(wcscpy(line, L"time,total"));
+        for (i = 0; i < connect_phase_max; ++i)
+        {
+            n = _snwprintf(line + len, _countof(line) - len, L",%s", ConnectPhaseName(i));
+            if (n < 0)
+                break;
+            len += n;
+        }
+        line[_countof(line) - 1] = L'\0';
+        WriteLogFileText(f, line);
+        WriteLogFileText(f, L"\r\n");
+    }
 
-    if (text_clr != 0)
+    GetLocalTime(&st);
+    _sntprintf_0(line, L"%04u-%02u-%02u %02u:%02u:%02u,%lu",
+                 st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, total);
+    len = wcslen(line);
+    for (i = 0; i < connect_phase_max; ++i)
     {
-        CHARFORMAT cfm = { .cbSize = sizeof(CHARFORMAT),
-                           .dwMask = CFM_COLOR|CFM_BOLD,
-                           .dwEffects = 0,
-                           .crTextColor = text_clr,
-                         };
-        SendMessage(logWnd, EM_SETCHARFORMAT, SCF_SELECTION, (LPARAM) &cfm);
+        if (cs->seen & (1 << i))
+            n = _snwprintf(line + len, _countof(line) - len, L",%lu", cs->ms[i]);
+        else
+            n = _snwprintf(line + len, _countof(line) - len, L",");
+        if (n < 0)
+            break;
+        len += n;
     }
+    line[_countof(line) - 1] = L'\0';
+    WriteLogFileText(f, line);
+    WriteLogFileText(f, L"\r\n");
+    CloseLogFile(f);
+}
 
-    /* Append line to log window */
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) datetime);
-    SendMessage(logWnd, EM_SETTEXTEX, (WPARAM) &ste, (LPARAM) message);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) _T("\n"));
+/*
+ * List the phases in the mask with a duration each, as "WAIT 1.2 s, AUTH 300 ms"
+ */
+static void
+FormatConnectPhases (WCHAR *buf, size_t size, DWORD seen, const DWORD *ms)
+{
+    WCHAR d[16];
+    size_t len = 0;
+    int i, n;
+
+    buf[0] = L'\0';
+    for (i = 0; i < connect_phase_max; ++i)
+    {
+        if (!(seen & (1 << i)))
+            continue;
+        FormatLatency(ms[i], d, _countof(d));
+        n = _snwprintf(buf + len, size - len, L"%s%s %s", len ? L", " : L"", ConnectPhaseName(i), d);
+        if (n < 0)
+            break;
+        len += n;
+    }
+    buf[size - 1] = L'\0';
 }
 
+/*
+ * Finish timing the connection attempt and report the time taken by it
+ * and by the attempts so far, as set by connect_stats
+ */
+static void
+ReportConnectTimes (connection_t *c)
+{
+    connect_stats_t *cs = &c->connect_stats;
+    WCHAR phases[512], msg[640], t[16], p50[16], p95[16], p99[16];
+    DWORD total, ms[connect_phase_max], seen = 0;
+    int i;
+
+    if (!EndConnectAttempt(cs, &total) || o.connect_stats == 0)
+        return;
+
+    FormatLatency(total, t, _countof(t));
+    FormatConnectPhases(phases, _countof(phases), cs->seen, cs->ms);
+    LoadLocalizedStringBuf(msg, _countof(msg), IDS_NFO_CONNECT_TIME, t, phases);
+    WriteStatusLog(c, L"OpenVPN GUI> ", msg, false);
+
+    if (cs->total.count > 1)
+    {
+        FormatLatency(LatencyPercentile(&cs->total, 50), p50, _countof(p50));
+        FormatLatency(LatencyPercentile(&cs->total, 95), p95, _countof(p95));
+        FormatLatency(LatencyPercentile(&cs->total, 99), p99, _countof(p99));
+        LoadLocalizedStringBuf(msg, _countof(msg), IDS_NFO_CONNECT_PERCENTILES,
+                               cs->total.count, p50, p95, p99);
+        WriteStatusLog(c, L"OpenVPN GUI> ", msg, false);
+
+        for (i = 0; i < connect_phase_max; ++i)
+        {
+            ms[i] = LatencyPercentile(&cs->phase[i], 95);
+            if (cs->phase[i].count)
+                seen |= 1 << i;
+        }
+        FormatConnectPhases(phases, _countof(phases), seen, ms);
+        LoadLocalizedStringBuf(msg, _countof(msg), IDS_NFO_CONNECT_PHASE_P95, phases);
+        WriteStatusLog(c, L"OpenVPN GUI> ", msg, false);
+    }
+
+    if (o.connect_stats == 2)
+        WriteConnectTimes(c, total);
+}
 
 /*
  * Handle a state change notification from the OpenVPN management interface
@@ -213,11 +562,18 @@ OnStateChange(connection_t *c, char *data)
         return;
     *pos = '\0';
 
+    EnterConnectPhase(&c->connect_stats, state);
+
     if (strcmp(state, "CONNECTED") == 0 && strcmp(message, "SUCCESS") == 0)
     {
+        conn_state_t prev;
+
+        if (!ConnStateEvent(c, ev_connected, &prev))
+            return;
+
         /* Run Connect Script */
-        if (c->state == connecting || c->state == resuming)
-            RunConnectScript(c, false);
+        if (prev == connecting || prev == resuming)
+            RunStatusJob(c, ConnectScriptJob, 0, 0, 0);
 
         /* Save the local IP address if available */
         char *local_ip = pos + 1;
@@ -229,9 +585,9 @@ OnStateChange(connection_t *c, char *data)
         MultiByteToWideChar(CP_UTF8, 0, local_ip, -1, c->ip, _countof(c->ip));
 
         /* Show connection tray balloon */
-        if ((c->state == connecting   && o.show_balloon != 0)
-        ||  (c->state == resuming     && o.show_balloon != 0)
-        ||  (c->state == reconnecting && o.show_balloon == 2))
+        if ((prev == connecting   && o.show_balloon != 0)
+        ||  (prev == resuming     && o.show_balloon != 0)
+        ||  (prev == reconnecting && o.show_balloon == 2))
         {
             TCHAR msg[256];
             LoadLocalizedStringBuf(msg, _countof(msg), IDS_NFO_NOW_CONNECTED, c->config_name);
@@ -240,12 +596,9 @@ OnStateChange(connection_t *c, char *data)
 
         /* Save time when we got connected. */
         c->connected_since = atoi(data);
-        c->failed_psw_attempts = 0;
-        c->failed_auth_attempts = 0;
-        c->state = connected;
-
-        SetMenuStatus(c, connected);
-        SetTrayIcon(connected);
+        ReportConnectTimes(c);
+        AutoStartSettled(c, TRUE);
+        ResumeSettled(c, TRUE);
 
         SetDlgItemText(c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_CONNECTED));
         SetStatusWinIcon(c->hwndStatus, ID_ICO_CONNECTED);
@@ -255,6 +608,10 @@ OnStateChange(connection_t *c, char *data)
     }
     else if (strcmp(state, "RECONNECTING") == 0)
     {
+        if (!ConnStateEvent(c, ev_reconnecting, NULL))
+            return;
+        StartConnectAttempt(&c->connect_stats);
+
         if (!c->dynamic_cr)
         {
             if (strcmp(message, "auth-failure") == 0)
@@ -269,14 +626,44 @@ OnStateChange(connection_t *c, char *data)
                 SaveKeyPass(c->config_name, L"");  /* clear saved private key password */
         }
 
-        c->state = reconnecting;
-        CheckAndSetTrayIcon();
-
         SetDlgItemText(c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_RECONNECTING));
         SetStatusWinIcon(c->hwndStatus, ID_ICO_CONNECTING);
     }
 }
 
+/*
+ * Handle a byte count notification from the OpenVPN management interface
+ * Format <BYTES_IN>,<BYTES_OUT>
+ */
+void
+OnByteCount(connection_t *c, char *msg)
+{
+    ULONGLONG rx, tx;
+    double rx_rate, tx_rate;
+    char *pos;
+
+    rx = _strtoui64(msg, &pos, 10);
+    if (*pos != ',')
+        return;
+    tx = _strtoui64(pos + 1, NULL, 10);
+
+    AddByteCount(&c->bytecount, rx, tx);
+
+    /* Show the current rate in the status window */
+    if (GetByteCountRate(&c->bytecount, BYTECOUNT_RATE_NOW, &rx_rate, &tx_rate))
+    {
+        WCHAR rx_str[32], tx_str[32];
+        FormatByteRate(rx_rate, rx_str, _countof(rx_str));
+        FormatByteRate(tx_rate, tx_str, _countof(tx_str));
+        SetDlgItemText(c->hwndStatus, ID_TXT_BYTECOUNT,
+                       LoadLocalizedString(IDS_NFO_BYTECOUNT, rx_str, tx_str));
+    }
+
+    /* The tray tip is only refreshed every few samples */
+    if (c->state == connected && c->bytecount.count % 5 == 0)
+        CheckAndSetTrayIcon();
+}
+
 /*
  * DialogProc for OpenVPN username/password/challenge auth dialog windows
  */
@@ -476,14 +863,14 @@ GenericPassDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
                 if (fmt)
                 {
                     sprintf(fmt, template, param->user);
-                    ManagementCommand(param->c, fmt, NULL, regular);
+                    ManagementReply(param->c, fmt, NULL, regular);
                     free(fmt);
                 }
                 else /* no memory? send an emty username and let it error out */
                 {
                     WriteStatusLog(param->c, L"GUI> ",
                         L"Out of memory: sending a generic username for dynamic CR", false);
-                    ManagementCommand(param->c, "username \"Auth\" \"user\"", NULL, regular);
+                    ManagementReply(param->c, "username \"Auth\" \"user\"", NULL, regular);
                 }
 
                 /* password template */
@@ -752,6 +1139,9 @@ OnEcho(connection_t *c, char *msg)
 {
     WCHAR errmsg[256];
 
+    if (msg == NULL)
+        return;
+
     PrintDebug(L"OnEcho with msg = %S", msg);
     if (!(msg = strchr(msg, ',')))
     {
@@ -831,7 +1221,7 @@ OnPassword(connection_t *c, char *msg)
                 free_auth_param (param);
                 return;
             }
-            LocalizedDialogBoxParam(ID_DLG_CHALLENGE_RESPONSE, GenericPassDialogFunc, (LPARAM) param);
+            StatusDialogBox(c, ID_DLG_CHALLENGE_RESPONSE, GenericPassDialogFunc, (LPARAM) param);
             free_dynamic_cr (c);
         }
         else if ( (chstr = strstr(msg, "SC:")) && strlen (chstr) > 5)
@@ -839,16 +1229,16 @@ OnPassword(connection_t *c, char *msg)
             param->flags |= FLAG_CR_TYPE_SCRV1;
             param->flags |= (*(chstr + 3) != '0') ? FLAG_CR_ECHO : 0;
             param->str = strdup(chstr + 5);
-            LocalizedDialogBoxParam(ID_DLG_AUTH_CHALLENGE, UserAuthDialogFunc, (LPARAM) param);
+            StatusDialogBox(c, ID_DLG_AUTH_CHALLENGE, UserAuthDialogFunc, (LPARAM) param);
         }
         else
         {
-            LocalizedDialogBoxParam(ID_DLG_AUTH, UserAuthDialogFunc, (LPARAM) param);
+            StatusDialogBox(c, ID_DLG_AUTH, UserAuthDialogFunc, (LPARAM) param);
         }
     }
     else if (strstr(msg, "'Private Key'"))
     {
-        LocalizedDialogBoxParam(ID_DLG_PASSPHRASE, PrivKeyPassDialogFunc, (LPARAM) c);
+        StatusDialogBox(c, ID_DLG_PASSPHRASE, PrivKeyPassDialogFunc, (LPARAM) c);
     }
     else if (strstr(msg, "'HTTP Proxy'"))
     {
@@ -874,7 +1264,7 @@ OnPassword(connection_t *c, char *msg)
             free_auth_param(param);
             return;
         }
-        LocalizedDialogBoxParam(ID_DLG_CHALLENGE_RESPONSE, GenericPassDialogFunc, (LPARAM) param);
+        StatusDialogBox(c, ID_DLG_CHALLENGE_RESPONSE, GenericPassDialogFunc, (LPARAM) param);
     }
 }
 
@@ -887,16 +1277,19 @@ OnStop(connection_t *c, UNUSED char *msg)
 {
     UINT txt_id, msg_id;
     TCHAR *msg_xtra;
-    SetMenuStatus(c, disconnected);
+    conn_state_t prev;
 
-    switch (c->state)
+    ConnStateEvent(c, ev_exit, &prev);
+    AutoStartSettled(c, FALSE);
+    ResumeSettled(c, FALSE);
+    ShutdownSettled(c);
+    FlushStatusLog(c);
+    SetDlgItemText(c->hwndStatus, ID_TXT_BYTECOUNT, _T(""));
+
+    switch (prev)
     {
     case connected:
         /* OpenVPN process ended unexpectedly */
-        c->failed_psw_attempts = 0;
-        c->failed_auth_attempts = 0;
-        c->state = disconnected;
-        CheckAndSetTrayIcon();
         SetDlgItemText(c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_DISCONNECTED));
         SetStatusWinIcon(c->hwndStatus, ID_ICO_DISCONNECTED);
         EnableWindow(GetDlgItem(c->hwndStatus, ID_DISCONNECT), FALSE);
@@ -906,9 +1299,7 @@ OnStop(connection_t *c, UNUSED char *msg)
             SetForegroundWindow(c->hwndStatus);
             ShowWindow(c->hwndStatus, SW_SHOW);
         }
-        MessageBox(c->hwndStatus, LoadLocalizedString(IDS_NFO_CONN_TERMINATED, c->config_file),
-                   _T(PACKAGE_NAME), MB_OK);
-        SendMessage(c->hwndStatus, WM_CLOSE, 0, 0);
+        StatusMessageAndClose(c, LoadLocalizedString(IDS_NFO_CONN_TERMINATED, c->config_file));
         break;
 
     case resuming:
@@ -916,15 +1307,12 @@ OnStop(connection_t *c, UNUSED char *msg)
     case reconnecting:
     case timedout:
         /* We have failed to (re)connect */
-        txt_id = c->state == reconnecting ? IDS_NFO_STATE_FAILED_RECONN : IDS_NFO_STATE_FAILED;
-        msg_id = c->state == reconnecting ? IDS_NFO_RECONN_FAILED : IDS_NFO_CONN_FAILED;
-        msg_xtra = c->state == timedout ? c->log_path : c->config_name;
-        if (c->state == timedout)
+        txt_id = prev == reconnecting ? IDS_NFO_STATE_FAILED_RECONN : IDS_NFO_STATE_FAILED;
+        msg_id = prev == reconnecting ? IDS_NFO_RECONN_FAILED : IDS_NFO_CONN_FAILED;
+        msg_xtra = prev == timedout ? c->log_path : c->config_name;
+        if (prev == timedout)
             msg_id = IDS_NFO_CONN_TIMEOUT;
 
-        c->state = disconnecting;
-        CheckAndSetTrayIcon();
-        c->state = disconnected;
         EnableWindow(GetDlgItem(c->hwndStatus, ID_DISCONNECT), FALSE);
         EnableWindow(GetDlgItem(c->hwndStatus, ID_RESTART), FALSE);
         SetStatusWinIcon(c->hwndStatus, ID_ICO_DISCONNECTED);
@@ -934,8 +1322,7 @@ OnStop(connection_t *c, UNUSED char *msg)
             SetForegroundWindow(c->hwndStatus);
             ShowWindow(c->hwndStatus, SW_SHOW);
         }
-        MessageBox(c->hwndStatus, LoadLocalizedString(msg_id, msg_xtra), _T(PACKAGE_NAME), MB_OK);
-        SendMessage(c->hwndStatus, WM_CLOSE, 0, 0);
+        StatusMessageAndClose(c, LoadLocalizedString(msg_id, msg_xtra));
         break;
 
     case disconnecting:
@@ -955,16 +1342,10 @@ OnStop(connection_t *c, UNUSED char *msg)
 //       ShowLocalizedMsg(IDS_ERR_CERT_NOT_YET_VALID);
 //     }
         /* Shutdown was initiated by us */
-        c->failed_psw_attempts = 0;
-        c->failed_auth_attempts = 0;
-        c->state = disconnected;
-        CheckAndSetTrayIcon();
         SendMessage(c->hwndStatus, WM_CLOSE, 0, 0);
         break;
 
     case suspending:
-        c->state = suspended;
-        CheckAndSetTrayIcon();
         SetDlgItemText(c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_SUSPENDED));
         break;
 
@@ -1000,129 +1381,535 @@ WrapLine (WCHAR *line)
 }
 
 /*
- * Write a line to the status log window and optionally to the log file
+ * Show the records added to the log model since the last update in the
+ * status window. Only the item count of the list view changes, rows are
+ * rendered on demand when they become visible.
  */
 static void
-WriteStatusLog (connection_t *c, const WCHAR *prefix, const WCHAR *line, BOOL fileio)
+FlushStatusLog (connection_t *c)
 {
     HWND logWnd = GetDlgItem(c->hwndStatus, ID_EDT_LOG);
-    FILE *log_fd;
-    time_t now;
-    WCHAR datetime[26];
+    ULONGLONG first, next, dropped;
+    int count, top;
+    BOOL follow;
 
-    time (&now);
-    /* TODO: change this to use _wctime_s when mingw supports it */
-    wcsncpy (datetime, _wctime(&now), _countof(datetime));
-    datetime[24] = L' ';
+    if (!logWnd)
+        return;
 
-    /* Remove lines from log window if it is getting full */
-    if (SendMessage(logWnd, EM_GETLINECOUNT, 0, 0) > MAX_LOG_LINES)
+    LogModelRange(&c->log, &first, &next);
+    dropped = first - c->log_view.first;
+    if (next - first == (ULONGLONG) ListView_GetItemCount(logWnd) && dropped == 0)
+        return;
+
+    /* Keep following new lines if the last line is visible */
+    count = ListView_GetItemCount(logWnd);
+    top = ListView_GetTopIndex(logWnd);
+    follow = (top + ListView_GetCountPerPage(logWnd) >= count);
+
+    if (next > c->log_view.next)
     {
-        int pos = SendMessage(logWnd, EM_LINEINDEX, DEL_LOG_LINES, 0);
-        SendMessage(logWnd, EM_SETSEL, 0, pos);
-        SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) _T(""));
+        c->log_view.lines_added += next - c->log_view.next;
+        c->log_view.max_batch = max(c->log_view.max_batch, (unsigned int) (next - c->log_view.next));
+        c->log_view.next = next;
     }
-    /* Append line to log window */
-    SendMessage(logWnd, EM_SETSEL, (WPARAM) -1, (LPARAM) -1);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) datetime);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) prefix);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) line);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) L"\n");
+    c->log_view.first = first;
+    c->log_view.updates++;
+    ListView_SetItemCountEx(logWnd, (int) (next - first), LVSICF_NOINVALIDATEALL|LVSICF_NOSCROLL);
 
-    if (!fileio) return;
-
-    log_fd = _tfopen (c->log_path, TEXT("at+,ccs=UTF-8"));
-    if (log_fd)
+    if (follow)
+        ListView_EnsureVisible(logWnd, (int) (next - first) - 1, FALSE);
+    else if (dropped)
     {
-        fwprintf (log_fd, L"%s%s%s\n", datetime, prefix, line);
-        fclose (log_fd);
+        /* Rows moved up, scroll to keep showing the same lines */
+        RECT rc;
+        if (ListView_GetItemRect(logWnd, top, &rc, LVIR_BOUNDS))
+            ListView_Scroll(logWnd, 0, -(int) min(dropped, (ULONGLONG) top) * (rc.bottom - rc.top));
     }
+    if (dropped)
+        InvalidateRect(logWnd, NULL, FALSE);
 }
 
-#define IO_TIMEOUT 5000 /* milliseconds */
-
-static void
-CloseServiceIO (service_io_t *s)
+/*
+ * FNV-1a hash of a log line, never 0
+ */
+static ULONGLONG
+HashStatusLog (WORD flags, const WCHAR *prefix, const WCHAR *line)
 {
-    if (s->hEvent)
-        CloseHandle(s->hEvent);
-    s->hEvent = NULL;
-    if (s->pipe && s->pipe != INVALID_HANDLE_VALUE)
-        CloseHandle(s->pipe);
-    s->pipe = NULL;
+    ULONGLONG h = 0xcbf29ce484222325ULL ^ flags;
+    const WCHAR *p;
+
+    for (p = prefix; *p; ++p)
+        h = (h ^ *p) * 0x100000001b3ULL;
+    for (p = line; *p; ++p)
+        h = (h ^ *p) * 0x100000001b3ULL;
+    return h ? h : 1;
 }
 
 /*
- * Open the service pipe and initialize service I/O.
- * Failure is not fatal.
+ * Add the lines reporting repeated and rate limited lines not shown
  */
-static BOOL
-InitServiceIO (service_io_t *s)
+static void
+ReportStatusLogFilter (connection_t *c, unsigned int repeats, time_t repeat_time,
+                       unsigned int limited, time_t timestamp)
 {
-    DWORD dwMode = PIPE_READMODE_MESSAGE;
-    CLEAR(*s);
+    WCHAR msg[256];
 
-    /* auto-reset event used for signalling i/o completion*/
-    s->hEvent = CreateEvent (NULL, FALSE, FALSE, NULL);
-    if (!s->hEvent)
+    if (repeats)
     {
-        return FALSE;
+        LoadLocalizedStringBuf(msg, _countof(msg), IDS_NFO_LOG_REPEATED, repeats);
+        LogModelAdd(&c->log, repeat_time, LOG_FLAG_GUI, L"OpenVPN GUI> ", msg);
     }
-
-    s->pipe = CreateFile(_T("\\\\.\\pipe\\openvpn\\service"),
-                GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
-
-    if ( !s->pipe                                               ||
-         s->pipe == INVALID_HANDLE_VALUE                        ||
-         !SetNamedPipeHandleState(s->pipe, &dwMode, NULL, NULL)
-       )
+    if (limited)
     {
-        CloseServiceIO (s);
-        return FALSE;
+        LoadLocalizedStringBuf(msg, _countof(msg), IDS_NFO_LOG_RATE_LIMITED, limited, o.log_rate_limit);
+        LogModelAdd(&c->log, timestamp, LOG_FLAG_GUI, L"OpenVPN GUI> ", msg);
     }
-
-    return TRUE;
 }
 
 /*
- * Read-completion routine for interactive service pipe. Call with
- * err = 0, bytes = 0 to queue the first read request.
+ * Report what the filter has not shown without waiting for a different
+ * line: repeats once none came for LOG_REPEAT_QUIET milliseconds and
+ * rate limited lines once their second is over, or all of it if force
+ * is set. Returns TRUE if counts are left to report later.
  */
-static void WINAPI
-HandleServiceIO (DWORD err, DWORD bytes, LPOVERLAPPED lpo)
+static BOOL
+FlushStatusLogFilter (connection_t *c, BOOL force)
 {
-    service_io_t *s = (service_io_t *) lpo;
-    int len, capacity;
-
-    len = _countof(s->readbuf);
-    capacity = (len-1)*sizeof(*(s->readbuf));
-
-    if (bytes > 0)
+    log_filter_t *f = &c->log_filter;
+    unsigned int repeats = 0, limited = 0;
+    time_t repeat_time = 0;
+    DWORD now = GetTickCount();
+    BOOL pending;
+
+    AcquireSRWLockExclusive(&f->lock);
+    if (f->repeats && (force || now - f->repeat_tick >= LOG_REPEAT_QUIET))
     {
-        /* messages from the service are not nul terminated */
-        int nchars = bytes/sizeof(s->readbuf[0]);
-        s->readbuf[nchars] = L'\0';
-        SetEvent (s->hEvent);
+        /* Keep the hash: more repeats are counted again */
+        repeats = f->repeats;
+        repeat_time = f->repeat_time;
+        f->repeats = 0;
     }
-    if (err)
+    if (f->limited && (force || now - f->window >= 1000))
     {
-        _snwprintf(s->readbuf, len, L"0x%08x\nInteractive Service disconnected\n", err);
-        s->readbuf[len-1] = L'\0';
-        SetEvent (s->hEvent);
-        return;
+        limited = f->limited;
+        f->limited = 0;
     }
+    pending = (f->repeats || f->limited);
+    ReleaseSRWLockExclusive(&f->lock);
 
-    /* queue next read request */
-    ReadFileEx (s->pipe, s->readbuf, capacity, lpo, HandleServiceIO);
-    /* Any error in the above call will get checked in next round */
+    ReportStatusLogFilter(c, repeats, repeat_time, limited, time(NULL));
+    return pending;
 }
 
 /*
- * Write size bytes in buf to the pipe with a timeout.
- * Retun value: TRUE on success FLASE on error
+ * Collapse repeats of the last line and limit the lines shown per
+ * second, as enabled by log_dedupe and log_rate_limit. Lines reporting
+ * what was not shown are added to the model before the current line.
+ * Returns FALSE if the line is not to be shown.
  */
 static BOOL
-WritePipe (HANDLE pipe, LPVOID buf, DWORD size)
+FilterStatusLog (connection_t *c, time_t timestamp, WORD flags, const WCHAR *prefix,
+                 const WCHAR *line)
+{
+    log_filter_t *f = &c->log_filter;
+    unsigned int repeats = 0, limited = 0;
+    time_t repeat_time = 0;
+    BOOL show = TRUE;
+
+    AcquireSRWLockExclusive(&f->lock);
+    if (o.log_dedupe)
+    {
+        ULONGLONG hash = HashStatusLog(flags, prefix, line);
+        if (hash == f->hash)
+        {
+            f->repeats++;
+            f->repeat_time = timestamp;
+            f->repeat_tick = GetTickCount();
+            f->suppressed++;
+            show = FALSE;
+        }
+        else
+        {
+            repeats = f->repeats;
+            repeat_time = f->repeat_time;
+            f->repeats = 0;
+            f->hash = hash;
+        }
+    }
+    if (show && o.log_rate_limit)
+    {
+        DWORD now = GetTickCount();
+        if (now - f->window >= 1000)
+        {
+            limited = f->limited;
+            f->window = now;
+            f->lines = 0;
+            f->limited = 0;
+        }
+        /* Errors are always shown */
+        if (f->lines >= o.log_rate_limit && !(flags & (LOG_FLAG_FATAL|LOG_FLAG_NONFATAL)))
+        {
+            f->limited++;
+            f->dropped++;
+            show = FALSE;
+            /* Show the next line, repeated or not, when the limit allows */
+            f->hash = 0;
+        }
+        else
+            f->lines++;
+    }
+    ReleaseSRWLockExclusive(&f->lock);
+
+    ReportStatusLogFilter(c, repeats, repeat_time, limited, timestamp);
+    return show;
+}
+
+/*
+ * Add a line to the log model. The status window is updated at most
+ * every LOG_FLUSH_INTERVAL milliseconds.
+ */
+static void
+QueueStatusLog (connection_t *c, time_t timestamp, WORD flags, const WCHAR *prefix,
+                const WCHAR *line)
+{
+    if (!c->hwndStatus)
+        return;
+
+    /* The journal keeps every line, shown or not */
+    WriteJournal(&c->journal, timestamp, flags, prefix, line);
+
+    if ((o.log_dedupe || o.log_rate_limit) && !FilterStatusLog(c, timestamp, flags, prefix, line))
+    {
+        /* The timer reports what was not shown if no other line follows */
+        ScheduleStatusLog(c);
+        return;
+    }
+
+    LogModelAdd(&c->log, timestamp, flags, prefix, line);
+    ScheduleStatusLog(c);
+}
+
+/*
+ * Have the status window show the new records of the log model, at the
+ * latest in LOG_FLUSH_INTERVAL milliseconds
+ */
+static void
+ScheduleStatusLog (connection_t *c)
+{
+    if (InterlockedExchange(&c->log_view.timer, 1) != 0)
+        return;
+
+    /* The timer can only be set by the thread of the status window */
+    if (!SetTimer(c->hwndStatus, IDT_LOG_TIMER, LOG_FLUSH_INTERVAL, NULL))
+        PostMessage(c->hwndStatus, WM_TIMER, IDT_LOG_TIMER, 0);
+}
+
+/*
+ * Format log record n for display. Returns the flags of the record or
+ * -1 if the record is no longer available.
+ */
+static int
+FormatStatusLog (connection_t *c, ULONGLONG n, WCHAR *buf, size_t size)
+{
+    log_record_t rec;
+    WCHAR msg[MAX_LOG_LENGTH];
+
+    if (!LogModelGet(&c->log, n, &rec, msg, _countof(msg)))
+    {
+        if (size)
+            buf[0] = L'\0';
+        return -1;
+    }
+
+    _snwprintf(buf, size, L"%s %s", LogTimeString(rec.timestamp), msg);
+    if (size)
+        buf[size - 1] = L'\0';
+    return rec.flags;
+}
+
+/*
+ * Copy the selected lines of the log window to the clipboard
+ */
+static void
+CopyStatusLog (connection_t *c, HWND logWnd)
+{
+    WCHAR line[MAX_LOG_LENGTH + 32];
+    WCHAR *text = NULL, *tmp;
+    size_t len = 0, size = 0, n;
+    HGLOBAL mem;
+    int i = -1;
+
+    while ((i = ListView_GetNextItem(logWnd, i, LVNI_SELECTED)) != -1)
+    {
+        FormatStatusLog(c, c->log_view.first + i, line, _countof(line));
+        n = wcslen(line);
+        if (len + n + 3 > size)
+        {
+            size = max(size * 2, len + n + 3);
+            tmp = realloc(text, size * sizeof(WCHAR));
+            if (!tmp)
+                goto out;
+            text = tmp;
+        }
+        wcscpy(text + len, line);
+        wcscpy(text + len + n, L"\r\n");
+        len += n + 2;
+    }
+    if (!text)
+        return;
+
+    mem = GlobalAlloc(GMEM_MOVEABLE, (len + 1) * sizeof(WCHAR));
+    if (mem && OpenClipboard(c->hwndStatus))
+    {
+        memcpy(GlobalLock(mem), text, (len + 1) * sizeof(WCHAR));
+        GlobalUnlock(mem);
+        EmptyClipboard();
+        if (SetClipboardData(CF_UNICODETEXT, mem))
+            mem = NULL;
+        CloseClipboard();
+    }
+    if (mem)
+        GlobalFree(mem);
+
+out:
+    free(text);
+}
+
+/*
+ * Select the next line of the log window containing the text of the
+ * find box, continuing from the top after the last line
+ */
+static void
+FindStatusLog (connection_t *c)
+{
+    HWND logWnd = GetDlgItem(c->hwndStatus, ID_EDT_LOG);
+    WCHAR query[256];
+    ULONGLONG from, n;
+    int sel, row;
+
+    GetDlgItemTextW(c->hwndStatus, ID_EDT_LOG_FIND, query, _countof(query));
+    if (query[0] == L'\0')
+        return;
+
+    /* Show pending lines first so that every match has a row */
+    FlushStatusLog(c);
+
+    sel = ListView_GetNextItem(logWnd, -1, LVNI_FOCUSED);
+    from = c->log_view.first + (sel >= 0 ? sel + 1 : 0);
+    if (!LogModelFind(&c->log, query, from, &n)
+        && !LogModelFind(&c->log, query, c->log_view.first, &n))
+    {
+        MessageBeep(MB_OK);
+        return;
+    }
+
+    row = (int) (n - c->log_view.first);
+    if (n < c->log_view.first || row >= ListView_GetItemCount(logWnd))
+        return;
+    ListView_SetItemState(logWnd, -1, 0, LVIS_SELECTED);
+    ListView_SetItemState(logWnd, row, LVIS_SELECTED|LVIS_FOCUSED, LVIS_SELECTED|LVIS_FOCUSED);
+    ListView_EnsureVisible(logWnd, row, FALSE);
+}
+
+/*
+ * Handle notifications of the log window
+ */
+static LRESULT
+OnStatusLogNotify (connection_t *c, NMHDR *hdr)
+{
+    switch (hdr->code)
+    {
+    case LVN_GETDISPINFO:
+    {
+        LVITEM *item = &((NMLVDISPINFO *) hdr)->item;
+        if (item->mask & LVIF_TEXT)
+            FormatStatusLog(c, c->log_view.first + item->iItem, item->pszText, item->cchTextMax);
+        break;
+    }
+
+    case NM_CUSTOMDRAW:
+    {
+        NMLVCUSTOMDRAW *cd = (NMLVCUSTOMDRAW *) hdr;
+        log_record_t rec;
+
+        if (cd->nmcd.dwDrawStage == CDDS_PREPAINT)
+            return CDRF_NOTIFYITEMDRAW;
+        if (cd->nmcd.dwDrawStage != CDDS_ITEMPREPAINT
+            || !LogModelGet(&c->log, c->log_view.first + cd->nmcd.dwItemSpec, &rec, NULL, 0))
+            break;
+
+        /* change text color if Warning or Error */
+        if (rec.flags & (LOG_FLAG_FATAL|LOG_FLAG_NONFATAL))
+            cd->clrText = o.clr_error;
+        else if (rec.flags & LOG_FLAG_WARN)
+            cd->clrText = o.clr_warning;
+        else
+            break;
+        return CDRF_NEWFONT;
+    }
+
+    case LVN_KEYDOWN:
+        if (((NMLVKEYDOWN *) hdr)->wVKey == VK_F3)
+            FindStatusLog(c);
+        if (GetKeyState(VK_CONTROL) >= 0)
+            break;
+        if (((NMLVKEYDOWN *) hdr)->wVKey == 'C')
+            CopyStatusLog(c, hdr->hwndFrom);
+        else if (((NMLVKEYDOWN *) hdr)->wVKey == 'A')
+            ListView_SetItemState(hdr->hwndFrom, -1, LVIS_SELECTED, LVIS_SELECTED);
+        else if (((NMLVKEYDOWN *) hdr)->wVKey == 'F')
+            SetFocus(GetDlgItem(c->hwndStatus, ID_EDT_LOG_FIND));
+        break;
+    }
+    return CDRF_DODEFAULT;
+}
+
+/*
+ * Release the log model and report how well updates were batched
+ */
+static void
+FreeStatusLog (connection_t *c)
+{
+    log_view_t *v = &c->log_view;
+    double secs;
+
+    /* Show what is still pending before the log goes */
+    FlushStatusLogFilter(c, TRUE);
+    FlushStatusLog(c);
+
+    secs = (GetTickCount() - v->opened) / 1000.0;
+    PrintDebug(L"Log window of %s: %I64u lines in %u updates (%.1f lines/update, max %u), %.1f lines/s",
+               c->config_name, v->lines_added, v->updates,
+               v->updates ? (double) v->lines_added / v->updates : 0.0, v->max_batch,
+               secs > 0 ? v->lines_added / secs : 0.0);
+    if (c->log_filter.suppressed || c->log_filter.dropped)
+        PrintDebug(L"Log window of %s: %I64u repeated lines collapsed, %I64u dropped by rate limit",
+                   c->config_name, c->log_filter.suppressed, c->log_filter.dropped);
+    LogModelFree(&c->log);
+    CLEAR(c->log_view);
+}
+
+/* A status log line written by another thread, see WriteStatusLog */
+typedef struct {
+    const WCHAR *prefix;
+    const WCHAR *line;
+    BOOL fileio;
+} status_log_request_t;
+
+/*
+ * Write a line to the status log window and optionally to the log file
+ */
+void
+WriteStatusLog (connection_t *c, const WCHAR *prefix, const WCHAR *line, BOOL fileio)
+{
+    time_t now;
+    WCHAR buf[MAX_LOG_LENGTH + 64];
+
+    /* Lines from other threads are written by the status thread */
+    if (c->hwndStatus && GetCurrentThreadId() != c->threadId)
+    {
+        status_log_request_t req = { prefix, line, fileio };
+        SendMessage(c->hwndStatus, WM_OVPN_LOG, 0, (LPARAM) &req);
+        return;
+    }
+
+    time (&now);
+
+    /* Append line to log window */
+    QueueStatusLog(c, now, LOG_FLAG_GUI, prefix, line);
+
+    if (!fileio) return;
+
+    /* Queue the line for the log writer thread */
+    _snwprintf (buf, _countof(buf), L"%s %s%s\r\n", LogTimeString(now), prefix, line);
+    buf[_countof(buf) - 1] = L'\0';
+    WriteLogFileText (c->log_file, buf);
+}
+
+#define IO_TIMEOUT 5000 /* milliseconds */
+
+static void
+CloseServiceIO (service_io_t *s)
+{
+    if (s->hEvent)
+        CloseHandle(s->hEvent);
+    s->hEvent = NULL;
+    if (s->pipe && s->pipe != INVALID_HANDLE_VALUE)
+        CloseHandle(s->pipe);
+    s->pipe = NULL;
+}
+
+/*
+ * Open the service pipe and initialize service I/O.
+ * Failure is not fatal.
+ */
+static BOOL
+InitServiceIO (service_io_t *s)
+{
+    DWORD dwMode = PIPE_READMODE_MESSAGE;
+    CLEAR(*s);
+
+    /* auto-reset event used for signalling i/o completion*/
+    s->hEvent = CreateEvent (NULL, FALSE, FALSE, NULL);
+    if (!s->hEvent)
+    {
+        return FALSE;
+    }
+
+    s->pipe = CreateFile(_T("\\\\.\\pipe\\openvpn\\service"),
+                GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+
+    if ( !s->pipe                                               ||
+         s->pipe == INVALID_HANDLE_VALUE                        ||
+         !SetNamedPipeHandleState(s->pipe, &dwMode, NULL, NULL)
+       )
+    {
+        CloseServiceIO (s);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Read-completion routine for interactive service pipe. Call with
+ * err = 0, bytes = 0 to queue the first read request.
+ */
+static void WINAPI
+HandleServiceIO (DWORD err, DWORD bytes, LPOVERLAPPED lpo)
+{
+    service_io_t *s = (service_io_t *) lpo;
+    int len, capacity;
+
+    len = _countof(s->readbuf);
+    capacity = (len-1)*sizeof(*(s->readbuf));
+
+    if (bytes > 0)
+    {
+        /* messages from the service are not nul terminated */
+        int nchars = bytes/sizeof(s->readbuf[0]);
+        s->readbuf[nchars] = L'\0';
+        SetEvent (s->hEvent);
+    }
+    if (err)
+    {
+        _snwprintf(s->readbuf, len, L"0x%08x\nInteractive Service disconnected\n", err);
+        s->readbuf[len-1] = L'\0';
+        SetEvent (s->hEvent);
+        return;
+    }
+
+    /* queue next read request */
+    ReadFileEx (s->pipe, s->readbuf, capacity, lpo, HandleServiceIO);
+    /* Any error in the above call will get checked in next round */
+}
+
+/*
+ * Write size bytes in buf to the pipe with a timeout.
+ * Retun value: TRUE on success FLASE on error
+ */
+static BOOL
+WritePipe (HANDLE pipe, LPVOID buf, DWORD size)
 {
     OVERLAPPED o;
     BOOL retval = FALSE;
@@ -1201,12 +1988,12 @@ OnService(connection_t *c, UNUSED char *msg)
             break;
         case ERROR_STARTUP_DATA:
             WriteStatusLog (c, prefix, L"OpenVPN not started due to previous errors", true);
-            c->state = timedout;   /* Force the popup message to include the log file name */
+            ConnStateEvent(c, ev_timeout, NULL); /* Force the popup message to include the log file name */
             OnStop (c, NULL);
             break;
         case ERROR_OPENVPN_STARTUP:
             WriteStatusLog (c, prefix, L"Check the log file for details", false);
-            c->state = timedout;   /* Force the popup message to include the log file name */
+            ConnStateEvent(c, ev_timeout, NULL); /* Force the popup message to include the log file name */
             OnStop(c, NULL);
             break;
         default:
@@ -1236,23 +2023,14 @@ OnProcess (connection_t *c, UNUSED char *msg)
 }
 
 /*
- * Called when NEED-OK is received
+ * Ask the user to confirm a NEED-OK request and send the response
  */
-void
-OnNeedOk (connection_t *c, char *msg)
+static void
+NeedOkJob (connection_t *c, LPARAM arg)
 {
     char *resp = NULL;
     WCHAR *wstr = NULL;
-    auth_param_t *param = (auth_param_t *) calloc(1, sizeof(auth_param_t));
-
-    if (!param)
-    {
-        WriteStatusLog(c, L"GUI> ", L"Error: out of memory while processing NEED-OK. Sending stop signal", false);
-        StopOpenVPN(c);
-        return;
-    }
-    if (!parse_input_request(msg, param))
-        goto out;
+    auth_param_t *param = (auth_param_t *) arg;
 
     /* allocate space for response : "needok param->id cancel/ok" */
     resp = malloc (strlen(param->id) + strlen("needok \' \' cancel"));
@@ -1272,12 +2050,12 @@ OnNeedOk (connection_t *c, char *msg)
     }
     else
     {
-        ManagementCommand (c, "auth-retry none", NULL, regular);
+        ManagementReply (c, "auth-retry none", NULL, regular);
         fmt = "needok \'%s\' cancel";
     }
 
     sprintf (resp, fmt, param->id);
-    ManagementCommand (c, resp, NULL, regular);
+    ManagementReply (c, resp, NULL, regular);
 
 out:
     free_auth_param (param);
@@ -1285,6 +2063,28 @@ out:
     free(resp);
 }
 
+/*
+ * Called when NEED-OK is received
+ */
+void
+OnNeedOk (connection_t *c, char *msg)
+{
+    auth_param_t *param = (auth_param_t *) calloc(1, sizeof(auth_param_t));
+
+    if (!param)
+    {
+        WriteStatusLog(c, L"GUI> ", L"Error: out of memory while processing NEED-OK. Sending stop signal", false);
+        StopOpenVPN(c);
+        return;
+    }
+    if (!parse_input_request(msg, param))
+    {
+        free_auth_param (param);
+        return;
+    }
+    RunStatusJob(c, NeedOkJob, (LPARAM) param, 0, 0);
+}
+
 /*
  * Called when NEED-STR is received
  */
@@ -1304,6 +2104,14 @@ Cleanup (connection_t *c)
 
     free_dynamic_cr (c);
 
+    FreeStatusLog (c);
+    PrintConnStateTrace (c);
+
+    /* Write out what is left of the log file and journal */
+    CloseLogFile (c->log_file);
+    c->log_file = NULL;
+    CloseJournal (&c->journal);
+
     if (c->hProcess)
         CloseHandle (c->hProcess);
     c->hProcess = NULL;
@@ -1323,9 +2131,12 @@ void
 RenderStatusWindow(HWND hwndDlg, UINT w, UINT h)
 {
         MoveWindow(GetDlgItem(hwndDlg, ID_EDT_LOG), DPI_SCALE(20), DPI_SCALE(25), w - DPI_SCALE(40), h - DPI_SCALE(70), TRUE);
-        MoveWindow(GetDlgItem(hwndDlg, ID_TXT_STATUS), DPI_SCALE(20), DPI_SCALE(5), w - DPI_SCALE(25), DPI_SCALE(15), TRUE);
+        MoveWindow(GetDlgItem(hwndDlg, ID_TXT_STATUS), DPI_SCALE(20), DPI_SCALE(5), w - DPI_SCALE(245), DPI_SCALE(15), TRUE);
+        MoveWindow(GetDlgItem(hwndDlg, ID_TXT_BYTECOUNT), w - DPI_SCALE(220), DPI_SCALE(5), DPI_SCALE(200), DPI_SCALE(15), TRUE);
         MoveWindow(GetDlgItem(hwndDlg, ID_DISCONNECT), DPI_SCALE(20), h - DPI_SCALE(30), DPI_SCALE(110), DPI_SCALE(23), TRUE);
         MoveWindow(GetDlgItem(hwndDlg, ID_RESTART), DPI_SCALE(145), h - DPI_SCALE(30), DPI_SCALE(110), DPI_SCALE(23), TRUE);
+        MoveWindow(GetDlgItem(hwndDlg, ID_EDT_LOG_FIND), DPI_SCALE(270), h - DPI_SCALE(29),
+                   max((int) w - DPI_SCALE(415), 0), DPI_SCALE(21), TRUE);
         MoveWindow(GetDlgItem(hwndDlg, ID_HIDE), w - DPI_SCALE(130), h - DPI_SCALE(30), DPI_SCALE(110), DPI_SCALE(23), TRUE);
 }
 
@@ -1344,6 +2155,18 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
         OnManagement(wParam, lParam);
         return TRUE;
 
+    case WM_MANAGEMENT_COMMAND:
+        /* Management command from another thread */
+        SetWindowLongPtr(hwndDlg, DWLP_MSGRESULT, OnManagementCommand(lParam));
+        return TRUE;
+
+    case WM_OVPN_LOG:
+        /* Status log line from another thread */
+        c = (connection_t *) GetProp(hwndDlg, cfgProp);
+        status_log_request_t *req = (status_log_request_t *) lParam;
+        WriteStatusLog(c, req->prefix, req->line, req->fileio);
+        return TRUE;
+
     case WM_INITDIALOG:
         c = (connection_t *) lParam;
 
@@ -1353,10 +2176,10 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
         /* Set connection for this dialog */
         SetProp(hwndDlg, cfgProp, (HANDLE) c);
 
-        /* Create log window */
-        HWND hLogWnd = CreateWindowEx(0, RICHEDIT_CLASS, NULL,
-            WS_CHILD|WS_VISIBLE|WS_HSCROLL|WS_VSCROLL|ES_SUNKEN|ES_LEFT|
-            ES_MULTILINE|ES_READONLY|ES_AUTOHSCROLL|ES_AUTOVSCROLL,
+        /* Create log window, rows are filled in from the log model on demand */
+        HWND hLogWnd = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, NULL,
+            WS_CHILD|WS_VISIBLE|WS_TABSTOP|LVS_REPORT|LVS_OWNERDATA|
+            LVS_NOCOLUMNHEADER|LVS_SHOWSELALWAYS,
             20, 25, 350, 160, hwndDlg, (HMENU) ID_EDT_LOG, o.hInstance, NULL);
         if (!hLogWnd)
         {
@@ -1364,16 +2187,30 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
             return FALSE;
         }
 
-        /* Set font and fontsize of the log window */
-        CHARFORMAT cfm = {
-            .cbSize = sizeof(CHARFORMAT),
-            .dwMask = CFM_SIZE|CFM_FACE|CFM_BOLD,
-            .szFaceName = _T("Microsoft Sans Serif"),
-            .dwEffects = 0,
-            .yHeight = 160
+        ListView_SetExtendedListViewStyle(hLogWnd, LVS_EX_FULLROWSELECT|LVS_EX_DOUBLEBUFFER);
+        LVCOLUMN col = {
+            .mask = LVCF_WIDTH,
+            .cx = DPI_SCALE(2000)
         };
-        if (SendMessage(hLogWnd, EM_SETCHARFORMAT, SCF_DEFAULT, (LPARAM) &cfm) == 0)
-            ShowLocalizedMsg(IDS_ERR_SET_SIZE);
+        ListView_InsertColumn(hLogWnd, 0, &col);
+        SendMessage(hLogWnd, WM_SETFONT, SendMessage(hwndDlg, WM_GETFONT, 0, 0), FALSE);
+
+        /* Create byte count display next to the status text */
+        HWND hByteWnd = CreateWindowEx(0, _T("STATIC"), NULL,
+            WS_CHILD|WS_VISIBLE|SS_RIGHT|SS_ENDELLIPSIS|SS_NOPREFIX,
+            170, 5, 200, 15, hwndDlg, (HMENU) ID_TXT_BYTECOUNT, o.hInstance, NULL);
+        if (hByteWnd)
+            SendMessage(hByteWnd, WM_SETFONT, SendDlgItemMessage(hwndDlg, ID_TXT_STATUS, WM_GETFONT, 0, 0), FALSE);
+
+        /* Create search box between the buttons, Enter finds the next match */
+        HWND hFindWnd = CreateWindowEx(WS_EX_CLIENTEDGE, _T("EDIT"), NULL,
+            WS_CHILD|WS_VISIBLE|WS_TABSTOP|ES_AUTOHSCROLL,
+            270, 185, 100, 21, hwndDlg, (HMENU) ID_EDT_LOG_FIND, o.hInstance, NULL);
+        if (hFindWnd)
+        {
+            SendMessage(hFindWnd, WM_SETFONT, SendMessage(hwndDlg, WM_GETFONT, 0, 0), FALSE);
+            SendMessage(hFindWnd, EM_SETCUEBANNER, FALSE, (LPARAM) LoadLocalizedString(IDS_NFO_LOG_FIND));
+        }
 
         /* Set size and position of controls */
         RECT rect;
@@ -1388,6 +2225,15 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
         InvalidateRect(hwndDlg, NULL, TRUE);
         return TRUE;
 
+    case WM_NOTIFY:
+        c = (connection_t *) GetProp(hwndDlg, cfgProp);
+        if (((NMHDR *) lParam)->idFrom == ID_EDT_LOG)
+        {
+            SetWindowLongPtr(hwndDlg, DWLP_MSGRESULT, OnStatusLogNotify(c, (NMHDR *) lParam));
+            return TRUE;
+        }
+        break;
+
     case WM_COMMAND:
         c = (connection_t *) GetProp(hwndDlg, cfgProp);
         switch (LOWORD(wParam))
@@ -1405,9 +2251,14 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
             return TRUE;
 
         case ID_RESTART:
-            c->state = reconnecting;
             SetFocus(GetDlgItem(c->hwndStatus, ID_EDT_LOG));
-            ManagementCommand(c, "signal SIGHUP", NULL, regular);
+            if (ConnStateEvent(c, ev_restart, NULL))
+                ManagementCommand(c, "signal SIGHUP", NULL, regular);
+            return TRUE;
+
+        case IDOK:
+            if (GetFocus() == GetDlgItem(hwndDlg, ID_EDT_LOG_FIND))
+                FindStatusLog(c);
             return TRUE;
         }
         break;
@@ -1434,27 +2285,42 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
         break;
 
     case WM_DESTROY:
-        PostQuitMessage(0);
+        if (GetCurrentThreadId() == shared_status.id)
+            PostThreadMessage(shared_status.id, WM_OVPN_RELEASE, 0, (LPARAM) GetProp(hwndDlg, cfgProp));
+        else
+            PostQuitMessage(0);
         break;
 
     case WM_OVPN_STOP:
         c = (connection_t *) GetProp(hwndDlg, cfgProp);
-        c->state = disconnecting;
-        RunDisconnectScript(c, false);
+        if (!ConnStateEvent(c, ev_stop, NULL))
+            break;
         EnableWindow(GetDlgItem(c->hwndStatus, ID_DISCONNECT), FALSE);
         EnableWindow(GetDlgItem(c->hwndStatus, ID_RESTART), FALSE);
-        SetMenuStatus(c, disconnecting);
         SetDlgItemText(c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_WAIT_TERM));
+        /* Stop OpenVPN once the disconnect script has run */
+        RunStatusJob(c, DisconnectScriptJob, 0, WM_OVPN_STOPPED, wParam);
+        break;
+
+    case WM_OVPN_STOPPED:
+        c = (connection_t *) GetProp(hwndDlg, cfgProp);
+        /* On shutdown ask OpenVPN to exit and leave escalating to the coordinator */
+        if (wParam)
+        {
+            if (!c->manage.ready || !ManagementCommand(c, "signal SIGTERM", NULL, regular))
+                SetEvent(c->exit_event);
+            break;
+        }
         SetEvent(c->exit_event);
         SetTimer(hwndDlg, IDT_STOP_TIMER, 3000, NULL);
         break;
 
     case WM_OVPN_SUSPEND:
         c = (connection_t *) GetProp(hwndDlg, cfgProp);
-        c->state = suspending;
+        if (!ConnStateEvent(c, ev_suspend, NULL))
+            break;
         EnableWindow(GetDlgItem(c->hwndStatus, ID_DISCONNECT), FALSE);
         EnableWindow(GetDlgItem(c->hwndStatus, ID_RESTART), FALSE);
-        SetMenuStatus(c, disconnecting);
         SetDlgItemText(c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_WAIT_TERM));
         SetEvent(c->exit_event);
         SetTimer(hwndDlg, IDT_STOP_TIMER, 3000, NULL);
@@ -1469,37 +2335,63 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
             TerminateOpenVPN(c);
             KillTimer (hwndDlg, IDT_STOP_TIMER);
         }
+        else if (wParam == IDT_LOG_TIMER)
+        {
+            KillTimer (hwndDlg, IDT_LOG_TIMER);
+            InterlockedExchange(&c->log_view.timer, 0);
+            if (FlushStatusLogFilter(c, FALSE))
+                ScheduleStatusLog(c);
+            FlushStatusLog(c);
+        }
         break;
     }
     return FALSE;
 }
 
 /*
- * ThreadProc for OpenVPN status dialog windows
+ * Create the status window of a connection and start monitoring it.
+ * Returns the handle to wait on for process or service events, or NULL
+ * if the window could not be created.
  */
-static DWORD WINAPI
-ThreadOpenVPNStatus(void *p)
+static HANDLE
+OpenStatusWindow(connection_t *c)
 {
-    connection_t *c = p;
     TCHAR conn_name[200];
-    MSG msg;
     HANDLE wait_event;
-
-    CLEAR (msg);
+    ULONGLONG first;
 
     /* Cut of extention from config filename. */
     _tcsncpy(conn_name, c->config_file, _countof(conn_name));
     conn_name[_tcslen(conn_name) - _tcslen(o.ext_string) - 1] = _T('\0');
 
-    c->state = (c->state == suspended ? resuming : connecting);
+    ConnStateEvent(c, ev_start, NULL);
+    StartConnectAttempt(&c->connect_stats);
+    ResetByteCount(&c->bytecount);
+
+    CLEAR(c->log_view);
+    CLEAR(c->log_filter);
+    if (!LogModelInit(&c->log, o.log_capacity))
+        PrintDebug(L"Failed to allocate log model for %s", c->config_name);
+    if (o.log_journal && !OpenJournal(&c->journal, c->log_path, &c->log, o.log_capacity))
+        PrintDebug(L"Failed to open log journal for %s", c->config_name);
+    c->log_file = OpenLogFile(c->log_path, LOG_FILE_UTF8);
+
+    /* Restored history does not count as lines added */
+    LogModelRange(&c->log, &first, &c->log_view.next);
+    c->log_view.opened = GetTickCount();
 
     /* Create and Show Status Dialog */
     c->hwndStatus = CreateLocalizedDialogParam(ID_DLG_STATUS, StatusDialogFunc, (LPARAM) c);
     if (!c->hwndStatus)
-        return 1;
+    {
+        LogModelFree(&c->log);
+        CloseJournal(&c->journal);
+        CloseLogFile(c->log_file);
+        c->log_file = NULL;
+        ConnStateEvent(c, ev_exit, NULL);
+        return NULL;
+    }
 
-    CheckAndSetTrayIcon();
-    SetMenuStatus(c, connecting);
     SetDlgItemText(c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_CONNECTING));
     SetWindowText(c->hwndStatus, LoadLocalizedString(IDS_NFO_CONNECTION_XXX, conn_name));
 
@@ -1518,6 +2410,37 @@ ThreadOpenVPNStatus(void *p)
     if (o.silent_connection == 0)
         ShowWindow(c->hwndStatus, SW_SHOW);
 
+    return wait_event;
+}
+
+/*
+ * Handle a signalled wait event of a connection
+ */
+static void
+OnStatusEvent(connection_t *c, HANDLE wait_event)
+{
+    if (wait_event == c->hProcess)
+        OnProcess (c, NULL);
+    else if (wait_event == c->iserv.hEvent)
+        OnService (c, NULL);
+}
+
+/*
+ * ThreadProc for OpenVPN status dialog windows
+ */
+static DWORD WINAPI
+ThreadOpenVPNStatus(void *p)
+{
+    connection_t *c = p;
+    MSG msg;
+    HANDLE wait_event;
+
+    CLEAR (msg);
+
+    wait_event = OpenStatusWindow(c);
+    if (!c->hwndStatus)
+        return 1;
+
     /* Run the message loop for the status window */
     while (WM_QUIT != msg.message)
     {
@@ -1527,10 +2450,7 @@ ThreadOpenVPNStatus(void *p)
             if ((res = MsgWaitForMultipleObjectsEx (1, &wait_event, INFINITE, QS_ALLINPUT,
                                          MWMO_ALERTABLE)) == WAIT_OBJECT_0)
             {
-                if (wait_event == c->hProcess)
-                    OnProcess (c, NULL);
-                else if (wait_event == c->iserv.hEvent)
-                    OnService (c, NULL);
+                OnStatusEvent (c, wait_event);
             }
             continue;
         }
@@ -1548,6 +2468,135 @@ ThreadOpenVPNStatus(void *p)
     return 0;
 }
 
+/*
+ * ThreadProc serving the status windows of many connections.
+ * Connections are handed over with a WM_OVPN_START thread message and
+ * given back with WM_OVPN_RELEASE when their status window is destroyed.
+ */
+static DWORD WINAPI
+ThreadSharedStatus(void *p)
+{
+    connection_t *conn[SHARED_STATUS_MAX];
+    HANDLE conn_event[SHARED_STATUS_MAX];
+    HANDLE wait_event[SHARED_STATUS_MAX];
+    int wait_conn[SHARED_STATUS_MAX];
+    int i, count = 0;
+    DWORD nwait, res;
+    connection_t *c;
+    MSG msg;
+
+    /* Make sure we have a message queue before anything is posted to it */
+    PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+    SetEvent((HANDLE) p);
+
+    while (TRUE)
+    {
+        if (!PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+        {
+            nwait = 0;
+            for (i = 0; i < count; i++)
+            {
+                if (conn_event[i] == NULL)
+                    continue;
+                wait_event[nwait] = conn_event[i];
+                wait_conn[nwait++] = i;
+            }
+
+            res = MsgWaitForMultipleObjectsEx (nwait, wait_event, INFINITE, QS_ALLINPUT,
+                                               MWMO_ALERTABLE);
+            if (res < WAIT_OBJECT_0 + nwait)
+            {
+                i = wait_conn[res - WAIT_OBJECT_0];
+                OnStatusEvent (conn[i], conn_event[i]);
+
+                /* An exited process stays signalled, stop waiting for it */
+                if (conn_event[i] == conn[i]->hProcess
+                    && WaitForSingleObject(conn[i]->hProcess, 0) == WAIT_OBJECT_0)
+                    conn_event[i] = NULL;
+            }
+            continue;
+        }
+
+        if (msg.hwnd == NULL)
+        {
+            c = (connection_t *) msg.lParam;
+            if (msg.message == WM_OVPN_START)
+            {
+                conn_event[count] = OpenStatusWindow(c);
+                if (c->hwndStatus)
+                    conn[count++] = c;
+                else
+                    InterlockedDecrement(&shared_status.count);
+            }
+            else if (msg.message == WM_OVPN_RELEASE)
+            {
+                for (i = 0; i < count && conn[i] != c; i++)
+                    ;
+                if (i == count)
+                    continue;
+
+                /* release handles etc.*/
+                Cleanup (c);
+                c->hwndStatus = NULL;
+
+                conn[i] = conn[--count];
+                conn_event[i] = conn_event[count];
+                InterlockedDecrement(&shared_status.count);
+            }
+            continue;
+        }
+
+        /* Keyboard navigation in the status window the message is for */
+        HWND root = GetAncestor(msg.hwnd, GA_ROOT);
+        for (i = 0; i < count && conn[i]->hwndStatus != root; i++)
+            ;
+        if (i < count && IsDialogMessage(root, &msg))
+            continue;
+
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+    return 0;
+}
+
+/*
+ * Reserve a place for one more connection on the shared status thread,
+ * starting the thread if required. Returns the thread id or 0 if the
+ * connection has to get a thread of its own.
+ */
+static DWORD
+ReserveSharedStatus(void)
+{
+    HANDLE thread, wait[2];
+    DWORD id;
+
+    if (!shared_status.id)
+    {
+        wait[0] = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (!wait[0])
+            return 0;
+        thread = CreateThread(NULL, 0, ThreadSharedStatus, wait[0], 0, &id);
+        if (thread)
+        {
+            wait[1] = thread;
+            if (WaitForMultipleObjects(2, wait, FALSE, INFINITE) == WAIT_OBJECT_0)
+                shared_status.id = id;
+            CloseHandle(thread);
+        }
+        CloseHandle(wait[0]);
+        if (!shared_status.id)
+            return 0;
+    }
+
+    if (InterlockedIncrement(&shared_status.count) > SHARED_STATUS_MAX)
+    {
+        InterlockedDecrement(&shared_status.count);
+        PrintDebug(L"Shared status thread is full -- using a dedicated thread");
+        return 0;
+    }
+    return shared_status.id;
+}
+
 /*
  * Set priority based on the registry or cmd-line value
  */
@@ -1574,42 +2623,77 @@ SetProcessPriority(DWORD *priority)
 }
 
 /*
- * Launch an OpenVPN process and the accompanying thread to monitor it
+ * Check whether the status window of a previous start is still open
+ */
+static BOOL
+StatusWindowOpen(connection_t *c)
+{
+    if (!c->hwndStatus)
+        return FALSE;
+
+    PrintDebug(L"Connection request when previous status window is still open -- ignored");
+    WriteStatusLog(c, L"OpenVPN GUI> ",
+                   L"Complete the pending dialog before starting a new connection", false);
+    SetForegroundWindow(c->hwndStatus);
+    return TRUE;
+}
+
+/*
+ * Run the pre-connect script and launch OpenVPN
  */
 BOOL
 StartOpenVPN(connection_t *c)
+{
+    if (StatusWindowOpen(c))
+        return FALSE;
+
+    RunPreconnectScript(c);
+    return LaunchOpenVPN(c);
+}
+
+/*
+ * Launch an OpenVPN process and the accompanying thread to monitor it,
+ * once the pre-connect script has been run
+ */
+BOOL
+LaunchOpenVPN(connection_t *c)
 {
     TCHAR cmdline[1024];
     TCHAR *options = cmdline + 8;
     TCHAR exit_event_name[17];
     HANDLE hStdInRead = NULL, hStdInWrite = NULL;
     HANDLE hNul = NULL, hThread = NULL;
-    DWORD written;
+    DWORD written, shared_id = 0;
     BOOL retval = FALSE;
+    static volatile LONG exit_event_count;
 
-    CLEAR(c->ip);
-
-    if (c->hwndStatus)
-    {
-        PrintDebug(L"Connection request when previous status window is still open -- ignored");
-        WriteStatusLog(c, L"OpenVPN GUI> ",
-                       L"Complete the pending dialog before starting a new connection", false);
-        SetForegroundWindow(c->hwndStatus);
+    if (StatusWindowOpen(c))
         return FALSE;
-    }
 
-    RunPreconnectScript(c);
+    CLEAR(c->ip);
+
+    /* OpenVPN cannot truncate a log file mapped by the built-in viewer */
+    if (!o.log_append)
+        CloseLogViewer(c->log_path);
 
-    /* Create thread to show the connection's status dialog */
-    hThread = CreateThread(NULL, 0, ThreadOpenVPNStatus, c, CREATE_SUSPENDED, &c->threadId);
-    if (hThread == NULL)
+    /* Create thread to show the connection's status dialog, unless a shared one is used */
+    if (o.shared_status_thread)
+        shared_id = ReserveSharedStatus();
+    if (shared_id)
+        c->threadId = shared_id;
+    else
     {
-        ShowLocalizedMsg(IDS_ERR_CREATE_THREAD_STATUS);
-        goto out;
+        hThread = CreateThread(NULL, 0, ThreadOpenVPNStatus, c, CREATE_SUSPENDED, &c->threadId);
+        if (hThread == NULL)
+        {
+            ShowLocalizedMsg(IDS_ERR_CREATE_THREAD_STATUS);
+            goto out;
+        }
     }
 
     /* Create an event object to signal OpenVPN to exit */
-    _sntprintf_0(exit_event_name, _T("%x%08x"), GetCurrentProcessId(), c->threadId);
+    _sntprintf_0(exit_event_name, _T("%x%08x"), GetCurrentProcessId(),
+                 InterlockedIncrement(&exit_event_count));
     c->exit_event = CreateEvent(NULL, TRUE, FALSE, exit_event_name);
     if (c->exit_event == NULL)
     {
@@ -1676,20 +2760,20 @@ StartOpenVPN(connection_t *c)
         {
             ShowLocalizedMsg(IDS_ERR_INIT_SEC_DESC);
             CloseHandle(c->exit_event);
-            return FALSE;
+            goto out;
         }
         if (!SetSecurityDescriptorDacl(&sd, TRUE, NULL, FALSE))
         {
             ShowLocalizedMsg(IDS_ERR_SET_SEC_DESC_ACL);
             CloseHandle(c->exit_event);
-            return FALSE;
+            goto out;
         }
 
         /* Set process priority */
         if (!SetProcessPriority(&priority))
         {
             CloseHandle(c->exit_event);
-            return FALSE;
+            goto out;
         }
 
         /* Get a handle of the NUL device */
@@ -1697,7 +2781,7 @@ StartOpenVPN(connection_t *c)
         if (hNul == INVALID_HANDLE_VALUE)
         {
             CloseHandle(c->exit_event);
-            return FALSE;
+            goto out;
         }
 
         /* Create the pipe for STDIN with only the read end inheritable */
@@ -1741,10 +2825,15 @@ StartOpenVPN(connection_t *c)
     }
 
     /* Start the status dialog thread */
-    ResumeThread(hThread);
+    if (shared_id)
+        PostThreadMessage(shared_id, WM_OVPN_START, 0, (LPARAM) c);
+    else
+        ResumeThread(hThread);
     retval = TRUE;
 
 out:
+    if (shared_id && !retval)
+        InterlockedDecrement(&shared_status.count);
     if (hThread && hThread != INVALID_HANDLE_VALUE)
         CloseHandle(hThread);
     if (hStdInWrite && hStdInWrite != INVALID_HANDLE_VALUE)
@@ -1763,6 +2852,13 @@ StopOpenVPN(connection_t *c)
     PostMessage(c->hwndStatus, WM_OVPN_STOP, 0, 0);
 }
 
+/* Stop without the terminate timer -- see StartShutdown */
+void
+ShutdownOpenVPN(connection_t *c)
+{
+    PostMessage(c->hwndStatus, WM_OVPN_STOP, 1, 0);
+}
+
 /* force-kill as a last resort */
 static BOOL
 TerminateOpenVPN (connection_t *c)
@@ -24,7 +24,11 @@
 #define OPENVPN_H
 
 BOOL StartOpenVPN(connection_t *);
+BOOL LaunchOpenVPN(connection_t *);
+void WriteStatusLog(connection_t *c, const WCHAR *prefix, const WCHAR *line, BOOL fileio);
 void StopOpenVPN(connection_t *);
+void ShutdownOpenVPN(connection_t *);
+void StatusDialogBox(connection_t *c, UINT id, DLGPROC proc, LPARAM param);
 void SuspendOpenVPN(int config);
 BOOL CheckVersion();
 void SetStatusWinIcon(HWND hwndDlg, int IconID);
@@ -32,12 +36,14 @@ void SetStatusWinIcon(HWND hwndDlg, int IconID);
 void OnReady(connection_t *, char *);
 void OnHold(connection_t *, char *);
 void OnLogLine(connection_t *, char *);
+void OnLogHistory(connection_t *, char *);
 void OnStateChange(connection_t *, char *);
 void OnPassword(connection_t *, char *);
 void OnStop(connection_t *, char *);
 void OnNeedOk(connection_t *, char *);
 void OnNeedStr(connection_t *, char *);
 void OnEcho(connection_t *, char *);
+void OnByteCount(connection_t *, char *);
 
 void ResetSavePasswords(connection_t *);
 
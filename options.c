@@ -203,6 +203,86 @@ add_option(options_t *options, int i, TCHAR **p)
         ++i;
         options->preconnectscript_timeout = _ttoi(p[1]);
     }
+    else if (streq(p[0], _T("management_pipeline")) && p[1])
+    {
+        ++i;
+        options->mgmt_pipeline = _ttoi(p[1]) ? 1 : 0;
+    }
+    else if (streq(p[0], _T("shared_status_thread")) && p[1])
+    {
+        ++i;
+        options->shared_status_thread = _ttoi(p[1]) ? 1 : 0;
+    }
+    else if (streq(p[0], _T("management_record")) && p[1])
+    {
+        ++i;
+        options->mgmt_record = _ttoi(p[1]) ? 1 : 0;
+    }
+    else if (streq(p[0], _T("log_capacity")) && p[1])
+    {
+        ++i;
+        options->log_capacity = _ttoi(p[1]);
+    }
+    else if (streq(p[0], _T("internal_log_viewer")) && p[1])
+    {
+        ++i;
+        options->internal_log_viewer = _ttoi(p[1]) ? 1 : 0;
+    }
+    else if (streq(p[0], _T("log_dedupe")) && p[1])
+    {
+        ++i;
+        options->log_dedupe = _ttoi(p[1]) ? 1 : 0;
+    }
+    else if (streq(p[0], _T("log_rate_limit")) && p[1])
+    {
+        ++i;
+        options->log_rate_limit = _ttoi(p[1]);
+    }
+    else if (streq(p[0], _T("log_journal")) && p[1])
+    {
+        ++i;
+        options->log_journal = _ttoi(p[1]) ? 1 : 0;
+    }
+    else if (streq(p[0], _T("log_backfill")) && p[1])
+    {
+        ++i;
+        options->log_backfill = _ttoi(p[1]);
+    }
+    else if (streq(p[0], _T("connect_stats")) && p[1])
+    {
+        ++i;
+        options->connect_stats = _ttoi(p[1]);
+    }
+    else if (streq(p[0], _T("autostart_concurrency")) && p[1])
+    {
+        ++i;
+        options->autostart_concurrency = _ttoi(p[1]);
+    }
+    else if (streq(p[0], _T("suspend_on_sleep")) && p[1])
+    {
+        ++i;
+        options->suspend_on_sleep = _ttoi(p[1]);
+    }
+    else if (streq(p[0], _T("resume_concurrency")) && p[1])
+    {
+        ++i;
+        options->resume_concurrency = _ttoi(p[1]);
+    }
+    else if (streq(p[0], _T("resume_stagger")) && p[1])
+    {
+        ++i;
+        options->resume_stagger = _ttoi(p[1]);
+    }
+    else if (streq(p[0], _T("resume_jitter")) && p[1])
+    {
+        ++i;
+        options->resume_jitter = _ttoi(p[1]);
+    }
+    else if (streq(p[0], _T("resume_order")) && p[1])
+    {
+        ++i;
+        _tcsncpy(options->resume_order, p[1], _countof(options->resume_order) - 1);
+    }
     else
     {
         /* Unrecognized option or missing parameter */
@@ -342,16 +422,87 @@ CountConnState(conn_state_t check)
     return count;
 }
 
+/*
+ * Map of management sockets to connections. Open addressing with linear
+ * probing, kept at most half full. Entries are added and removed by the
+ * status threads, so access is serialized with a slim reader/writer lock.
+ */
+#define SK_MAP_SIZE (2 * MAX_CONFIGS)
+
+static struct {
+    SOCKET sk;
+    connection_t *c;        /* NULL if the slot is free */
+} sk_map[SK_MAP_SIZE];
+static SRWLOCK sk_map_lock = SRWLOCK_INIT;
+
+static unsigned int
+SkMapSlot(SOCKET sk)
+{
+    /* socket handles are multiples of 4 */
+    return (unsigned int) (((ULONGLONG) sk >> 2) * 2654435761u % SK_MAP_SIZE);
+}
+
+void
+MapConnManagement(connection_t *c)
+{
+    unsigned int i;
+
+    AcquireSRWLockExclusive(&sk_map_lock);
+    for (i = SkMapSlot(c->manage.sk); sk_map[i].c; i = (i + 1) % SK_MAP_SIZE)
+    {
+        if (sk_map[i].sk == c->manage.sk)
+            break;
+    }
+    sk_map[i].sk = c->manage.sk;
+    sk_map[i].c = c;
+    ReleaseSRWLockExclusive(&sk_map_lock);
+}
+
+void
+UnmapConnManagement(connection_t *c)
+{
+    unsigned int i, j, k;
+
+    AcquireSRWLockExclusive(&sk_map_lock);
+    for (i = SkMapSlot(c->manage.sk); sk_map[i].c; i = (i + 1) % SK_MAP_SIZE)
+    {
+        if (sk_map[i].c == c)
+            break;
+    }
+    if (sk_map[i].c)
+    {
+        /* Move later entries of the probe sequence into the hole */
+        for (j = (i + 1) % SK_MAP_SIZE; sk_map[j].c; j = (j + 1) % SK_MAP_SIZE)
+        {
+            k = SkMapSlot(sk_map[j].sk);
+            if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+            {
+                sk_map[i] = sk_map[j];
+                i = j;
+            }
+        }
+        sk_map[i].c = NULL;
+    }
+    ReleaseSRWLockExclusive(&sk_map_lock);
+}
+
 connection_t*
 GetConnByManagement(SOCKET sk)
 {
-    int i;
-    for (i = 0; i < o.num_configs; ++i)
+    unsigned int i;
+    connection_t *c = NULL;
+
+    AcquireSRWLockShared(&sk_map_lock);
+    for (i = SkMapSlot(sk); sk_map[i].c; i = (i + 1) % SK_MAP_SIZE)
     {
-        if (o.conn[i].manage.sk == sk)
-            return &o.conn[i];
+        if (sk_map[i].sk == sk)
+        {
+            c = sk_map[i].c;
+            break;
+        }
     }
-    return NULL;
+    ReleaseSRWLockShared(&sk_map_lock);
+    return c;
 }
 
 /* callback to set the initial value of folder browse selection */
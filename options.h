@@ -33,6 +33,11 @@ typedef struct connection connection_t;
 #include <lmcons.h>
 
 #include "manage.h"
+#include "stats.h"
+#include "log_model.h"
+#include "log_writer.h"
+#include "journal.h"
+#include "conn_state.h"
 
 #define MAX_NAME (UNLEN + 1)
 
@@ -62,19 +67,6 @@ typedef enum {
     socks
 } proxy_t;
 
-/* connection states */
-typedef enum {
-    disconnected,
-    connecting,
-    reconnecting,
-    connected,
-    disconnecting,
-    suspending,
-    suspended,
-    resuming,
-    timedout
-} conn_state_t;
-
 /* Interactive Service IO parameters */
 typedef struct {
     OVERLAPPED o; /* This has to be the first element */
@@ -83,6 +75,33 @@ typedef struct {
     WCHAR readbuf[512];
 } service_io_t;
 
+/* State of showing the log model in the status window */
+typedef struct {
+    volatile LONG timer;        /* update timer is running */
+    ULONGLONG first;            /* number of the record shown in the first row */
+    ULONGLONG next;             /* number of the record after the last one shown */
+    ULONGLONG lines_added;      /* # of lines added to the window since it was opened */
+    unsigned int updates;       /* # of times the window was updated */
+    unsigned int max_batch;     /* most lines added in one update */
+    DWORD opened;               /* GetTickCount() when the window was opened */
+    time_t history_since;       /* log history up to this time is already shown */
+    ULONGLONG history_hash;     /* hash of the last line shown at that time, 0 once seen */
+} log_view_t;
+
+/* State of collapsing repeated lines and rate limiting the log window */
+typedef struct {
+    SRWLOCK lock;
+    ULONGLONG hash;             /* hash of the last line shown, 0 if none */
+    unsigned int repeats;       /* # of repeats of the last line not shown */
+    time_t repeat_time;         /* time of the last of those repeats */
+    DWORD repeat_tick;          /* GetTickCount() of the last of those repeats */
+    DWORD window;               /* start of the current second, in ticks */
+    unsigned int lines;         /* # of lines shown in the current second */
+    unsigned int limited;       /* # of lines not shown in the current second */
+    ULONGLONG suppressed;       /* total # of repeated lines collapsed */
+    ULONGLONG dropped;          /* total # of lines dropped by the rate limit */
+} log_filter_t;
+
 #define FLAG_ALLOW_CHANGE_PASSPHRASE (1<<1)
 #define FLAG_SAVE_KEY_PASS  (1<<4)
 #define FLAG_SAVE_AUTH_PASS (1<<5)
@@ -101,6 +120,8 @@ struct connection {
     TCHAR ip[16];                   /* Assigned IP address for this connection */
     BOOL auto_connect;              /* AutoConnect at startup id TRUE */
     conn_state_t state;             /* State the connection currently is in */
+    conn_trace_t trace;             /* Recent state transitions, see ConnStateEvent */
+    connect_stats_t connect_stats;  /* Time taken by connection attempts */
     int failed_psw_attempts;        /* # of failed attempts entering password(s) */
     int failed_auth_attempts;       /* # of failed user-auth attempts */
     time_t connected_since;         /* Time when the connection was established */
@@ -111,10 +132,17 @@ struct connection {
         SOCKADDR_IN skaddr;
         time_t timeout;
         char password[16];
-        char *saved_data;
-        size_t saved_size;
+        mgmt_rbuf_t rbuf;
         mgmt_cmd_t *cmd_queue;
+        unsigned int cmd_count;     /* # of commands in cmd_queue */
+        mgmt_cmd_t *cmd_free;       /* Released command nodes kept for reuse */
+        unsigned int cmd_free_count;
         BOOL connected;             /* True, if management interface has connected */
+        BOOL ready;                 /* True, once management interface accepts commands */
+        unsigned int unknown_rtmsg; /* # of unrecognized real-time notifications */
+        mgmt_stats_t stats;
+        HANDLE record;              /* Transcript of received data if management_record is set */
+        DWORD record_start;         /* GetTickCount() when the transcript was started */
     } manage;
 
     HANDLE hProcess;                /* Handle of openvpn process if directly started */
@@ -123,6 +151,12 @@ struct connection {
     HANDLE exit_event;
     DWORD threadId;
     HWND hwndStatus;
+    bytecount_t bytecount;          /* Recent byte counts of the tunnel */
+    log_model_t log;                /* Recent log lines of the connection */
+    log_view_t log_view;            /* Log lines shown in the status window */
+    log_filter_t log_filter;        /* Repeated and excess lines not shown */
+    log_file_t *log_file;           /* Log file for lines written by the GUI */
+    journal_t journal;              /* Binary journal of the log records */
     int flags;
     char *dynamic_cr;              /* Pointer to buffer for dynamic challenge string received */
 };
@@ -166,6 +200,22 @@ typedef struct {
     DWORD connectscript_timeout;        /* Connect Script execution timeout (sec) */
     DWORD disconnectscript_timeout;     /* Disconnect Script execution timeout (sec) */
     DWORD preconnectscript_timeout;     /* Preconnect Script execution timeout (sec) */
+    DWORD mgmt_pipeline;                /* Send management commands without waiting for responses */
+    DWORD shared_status_thread;         /* Serve all status windows from one thread */
+    DWORD mgmt_record;                  /* Record management interface output to a file */
+    DWORD log_capacity;                 /* Max # of log lines kept per connection */
+    DWORD internal_log_viewer;          /* View log files in a built-in window */
+    DWORD log_dedupe;                   /* Collapse repeated log lines */
+    DWORD log_rate_limit;               /* Max # of log lines shown per second, 0 for no limit */
+    DWORD log_journal;                  /* Keep a binary journal of log records to restore history */
+    DWORD log_backfill;                 /* # of log history lines requested on attach */
+    DWORD connect_stats;                /* Report connect times: 1 in the log window, 2 also to a CSV file */
+    DWORD autostart_concurrency;        /* Max # of connections prepared at once on auto-start */
+    DWORD suspend_on_sleep;             /* Suspend connections when the computer goes to sleep */
+    DWORD resume_concurrency;           /* Max # of connections connecting at once on resume */
+    DWORD resume_stagger;               /* Min ms between restarts on resume */
+    DWORD resume_jitter;                /* Max random ms added to resume_stagger */
+    TCHAR resume_order[1024];           /* Config names to resume first, comma separated */
 
 #ifdef DEBUG
     FILE *debug_fp;
@@ -186,6 +236,8 @@ void InitOptions(options_t *);
 void ProcessCommandLine(options_t *, TCHAR *);
 int CountConnState(conn_state_t);
 connection_t* GetConnByManagement(SOCKET);
+void MapConnManagement(connection_t *);
+void UnmapConnManagement(connection_t *);
 INT_PTR CALLBACK ScriptSettingsDlgProc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam);
 INT_PTR CALLBACK ConnectionSettingsDlgProc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam);
 INT_PTR CALLBACK AdvancedSettingsDlgProc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam);
@@ -390,7 +390,7 @@ void
 QueryProxyAuth(connection_t *c, proxy_t type)
 {
     c->proxy_type = type;
-    LocalizedDialogBoxParam(ID_DLG_PROXY_AUTH, ProxyAuthDialogFunc, (LPARAM) c);
+    StatusDialogBox(c, ID_DLG_PROXY_AUTH, ProxyAuthDialogFunc, (LPARAM) c);
 }
 
 
@@ -601,7 +601,7 @@ OnProxy(connection_t *c, char *line)
     char cmd[128];
     snprintf(cmd, sizeof(cmd), "proxy %s %S %S", type, addr, port);
     cmd[sizeof(cmd) - 1] = '\0';
-    ManagementCommand(c, cmd, NULL, regular);
+    ManagementReply(c, cmd, NULL, regular);
 
     GlobalFree(proxy_str);
 }
@@ -45,7 +45,8 @@ struct regkey_str {
 } regkey_str[] = {
       {L"config_dir", o.config_dir, _countof(o.config_dir), L"%USERPROFILE%\\OpenVPN\\config"},
       {L"config_ext", o.ext_string, _countof(o.ext_string), L"ovpn"},
-      {L"log_dir", o.log_dir, _countof(o.log_dir), L"%USERPROFILE%\\OpenVPN\\log"}
+      {L"log_dir", o.log_dir, _countof(o.log_dir), L"%USERPROFILE%\\OpenVPN\\log"},
+      {L"resume_order", o.resume_order, _countof(o.resume_order), L""}
     };
 
 struct regkey_int {
@@ -60,7 +61,22 @@ struct regkey_int {
       {L"connectscript_timeout", &o.connectscript_timeout, 30},
       {L"disconnectscript_timeout", &o.disconnectscript_timeout, 10},
       {L"show_script_window", &o.show_script_window, 0},
-      {L"service_only", &o.service_only, 0}
+      {L"service_only", &o.service_only, 0},
+      {L"management_pipeline", &o.mgmt_pipeline, 1},
+      {L"shared_status_thread", &o.shared_status_thread, 0},
+      {L"management_record", &o.mgmt_record, 0},
+      {L"log_capacity", &o.log_capacity, 20000},
+      {L"internal_log_viewer", &o.internal_log_viewer, 0},
+      {L"log_dedupe", &o.log_dedupe, 0},
+      {L"log_rate_limit", &o.log_rate_limit, 0},
+      {L"log_journal", &o.log_journal, 1},
+      {L"log_backfill", &o.log_backfill, 1000},
+      {L"connect_stats", &o.connect_stats, 1},
+      {L"autostart_concurrency", &o.autostart_concurrency, 4},
+      {L"suspend_on_sleep", &o.suspend_on_sleep, 0},
+      {L"resume_concurrency", &o.resume_concurrency, 2},
+      {L"resume_stagger", &o.resume_stagger, 500},
+      {L"resume_jitter", &o.resume_jitter, 1000}
     };
 
 static int
@@ -187,6 +203,12 @@ GetRegistryKeys ()
         ShowLocalizedMsg(IDS_ERR_PRECONN_SCRIPT_TIMEOUT);
         o.preconnectscript_timeout = 10;
     }
+    if (o.log_capacity < 100)
+        o.log_capacity = 100;
+    else if (o.log_capacity > 1000000)
+        o.log_capacity = 1000000;
+    if (o.log_backfill > o.log_capacity)
+        o.log_backfill = o.log_capacity;
 
     ExpandOptions ();
     return true;
@@ -0,0 +1,248 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <tchar.h>
+#include <wchar.h>
+
+#include "main.h"
+#include "options.h"
+#include "openvpn.h"
+#include "openvpn-gui-res.h"
+#include "localization.h"
+#include "conn_state.h"
+#include "autostart.h"
+#include "resume.h"
+
+extern options_t o;
+
+/*
+ * Suspended connections waiting to be restarted. Restarts are spaced by
+ * resume_stagger plus a random jitter, and at most resume_concurrency
+ * connections are connecting at a time, so that many tunnels do not all
+ * start their TLS handshakes at once. The queue is only touched by the
+ * main window thread; pre-connect scripts run on worker threads as for
+ * auto-started connections, which settle on their status thread.
+ */
+static struct {
+    connection_t *queue[MAX_CONFIGS];
+    int count;
+    int next;                       /* index of the next connection to restart */
+    volatile LONG running;          /* # of restarted connections not settled yet */
+    volatile LONG connected;        /* # of restarted connections that connected */
+    volatile LONG waiting[MAX_CONFIGS];  /* connection is counted in running */
+    connection_t *last;             /* connection that settled last */
+    ULONGLONG start;                /* tick when the resume began */
+    ULONGLONG due;                  /* earliest tick for the next restart */
+    DWORD seed;
+    BOOL active;
+} resume;
+
+/*
+ * Random delay of up to resume_jitter milliseconds
+ */
+static DWORD
+Jitter(void)
+{
+    if (o.resume_jitter == 0)
+        return 0;
+
+    /* xorshift32 */
+    resume.seed ^= resume.seed << 13;
+    resume.seed ^= resume.seed >> 17;
+    resume.seed ^= resume.seed << 5;
+    return resume.seed % (o.resume_jitter + 1);
+}
+
+/*
+ * Position of a connection in resume_order, a comma separated list of
+ * config names. Connections not listed follow in menu order.
+ */
+static int
+ResumePriority(connection_t *c)
+{
+    const WCHAR *p = o.resume_order;
+    size_t len = _tcslen(c->config_name);
+    int n = 0;
+
+    while (*p)
+    {
+        const WCHAR *end = wcschr(p, L',');
+        size_t item = end ? (size_t) (end - p) : wcslen(p);
+
+        while (item && *p == L' ')
+            p++, item--;
+        while (item && p[item - 1] == L' ')
+            item--;
+        if (item == len && _wcsnicmp(p, c->config_name, len) == 0)
+            return n;
+
+        n++;
+        if (!end)
+            break;
+        p = end + 1;
+    }
+    return MAX_CONFIGS + (int) (c - o.conn);
+}
+
+/* Retry interval for queued connections that are still suspending */
+#define RESUME_RETRY 250
+
+/*
+ * Queue all suspended connections for restart, highest priority first,
+ * and start restarting them. Connections still suspending are queued
+ * too and restarted once suspended. A resume still in progress
+ * continues with the new queue.
+ */
+void
+ScheduleResume(void)
+{
+    int prio[MAX_CONFIGS];
+    int i, j;
+
+    resume.count = resume.next = 0;
+    for (i = 0; i < o.num_configs && resume.count < MAX_CONFIGS; i++)
+    {
+        connection_t *c = &o.conn[i];
+        int p;
+
+        if (c->state != suspended && c->state != suspending)
+            continue;
+
+        /* Insertion sort, the list is short */
+        p = ResumePriority(c);
+        for (j = resume.count; j > 0 && prio[j - 1] > p; j--)
+        {
+            prio[j] = prio[j - 1];
+            resume.queue[j] = resume.queue[j - 1];
+        }
+        prio[j] = p;
+        resume.queue[j] = c;
+        resume.count++;
+    }
+
+    if (!resume.active)
+    {
+        resume.active = TRUE;
+        resume.start = resume.due = GetTickCount64();
+        resume.connected = 0;
+        resume.last = NULL;
+        resume.seed = GetTickCount() | 1;
+    }
+    PrintDebug(L"Resume: %d connections queued", resume.count);
+
+    RunResumeQueue();
+}
+
+/*
+ * Restart queued connections that are due, as allowed by
+ * resume_concurrency, and arm a timer for the next one. Runs on the
+ * main window thread on WM_RESUME and the resume timer.
+ */
+void
+RunResumeQueue(void)
+{
+    ULONGLONG now = GetTickCount64();
+    WCHAR msg[256];
+
+    KillTimer(o.hWnd, IDT_RESUME_TIMER);
+    if (!resume.active)
+        return;
+
+    while (resume.next < resume.count
+           && (o.resume_concurrency == 0 || resume.running < (LONG) o.resume_concurrency))
+    {
+        connection_t *c;
+        LONG n;
+        int i;
+
+        if (now < resume.due)
+        {
+            SetTimer(o.hWnd, IDT_RESUME_TIMER, (UINT) (resume.due - now), NULL);
+            return;
+        }
+
+        /* Connections still suspending wait behind the others. The stop
+         * timer of their status window terminates OpenVPN within seconds. */
+        for (i = resume.next; i < resume.count && resume.queue[i]->state == suspending; i++)
+            ;
+        if (i == resume.count)
+        {
+            SetTimer(o.hWnd, IDT_RESUME_TIMER, RESUME_RETRY, NULL);
+            return;
+        }
+        c = resume.queue[i];
+        for (; i > resume.next; i--)
+            resume.queue[i] = resume.queue[i - 1];
+        resume.queue[resume.next++] = c;
+        n = c - o.conn;
+
+        /* Stopped or started by the user in the meantime */
+        if (c->state != suspended || c->hwndStatus
+            || !ConnStateEvent(c, ev_prepare, NULL))
+            continue;
+
+        /* Settles in OnAutoStart if it cannot be launched */
+        InterlockedExchange(&resume.waiting[n], 1);
+        InterlockedIncrement(&resume.running);
+        PrepareConnection(c);
+
+        now = GetTickCount64();
+        resume.due = now + o.resume_stagger + Jitter();
+    }
+
+    if (resume.next < resume.count || resume.running)
+        return;
+
+    resume.active = FALSE;
+    now = GetTickCount64();
+    PrintDebug(L"Resume: %ld connections connected in %I64u ms", resume.connected, now - resume.start);
+    if (resume.last && resume.connected)
+    {
+        LoadLocalizedStringBuf(msg, _countof(msg), IDS_NFO_RESUME_DONE,
+                               resume.connected, (now - resume.start) / 1000.0);
+        WriteStatusLog(resume.last, L"OpenVPN GUI> ", msg, false);
+    }
+}
+
+/*
+ * Count a restarted connection as connected or failed, and have the
+ * main window restart the next one
+ */
+void
+ResumeSettled(connection_t *c, BOOL connected)
+{
+    LONG n = c - o.conn;
+
+    if (n < 0 || n >= MAX_CONFIGS || InterlockedExchange(&resume.waiting[n], 0) == 0)
+        return;
+
+    if (connected)
+    {
+        InterlockedIncrement(&resume.connected);
+        resume.last = c;
+    }
+    InterlockedDecrement(&resume.running);
+    PostMessage(o.hWnd, WM_RESUME, 0, 0);
+}
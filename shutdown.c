@@ -0,0 +1,291 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <limits.h>
+
+#include "main.h"
+#include "options.h"
+#include "openvpn.h"
+#include "shutdown.h"
+
+extern options_t o;
+
+typedef enum {
+    stop_signal,            /* asked OpenVPN to exit through the management interface */
+    stop_event,             /* signalled the exit event */
+    stop_kill,              /* terminated the process */
+    stop_done
+} stop_step_t;
+
+/* A connection being stopped */
+typedef struct {
+    connection_t *c;
+    HANDLE done;            /* signalled by ShutdownSettled */
+    HANDLE process;         /* duplicate of the process handle, if started directly */
+    HANDLE exit_event;      /* duplicate of the exit event */
+    stop_step_t step;
+    ULONGLONG deadline;     /* tick when to escalate to the next step */
+} stopping_t;
+
+/*
+ * Stops all connections at once and escalates each on its own deadlines
+ * on a thread of its own, so that the caller does not have to poll.
+ */
+static struct {
+    SRWLOCK lock;
+    BOOL active;
+    HANDLE thread;
+    HWND hwnd;              /* notified with WM_SHUTDOWN when done */
+    int count;
+    stopping_t conn[MAX_CONFIGS];
+    ULONGLONG start;
+    volatile LONG given_up[MAX_CONFIGS];  /* still running after the last step */
+} coordinator = { .lock = SRWLOCK_INIT };
+
+static HANDLE
+DuplicateLocal(HANDLE h)
+{
+    HANDLE dup = NULL;
+
+    if (h && !DuplicateHandle(GetCurrentProcess(), h, GetCurrentProcess(), &dup,
+                              0, FALSE, DUPLICATE_SAME_ACCESS))
+        dup = NULL;
+    return dup;
+}
+
+/*
+ * Move a connection to the next step of stopping it
+ */
+static void
+Escalate(stopping_t *s, ULONGLONG now)
+{
+    switch (s->step)
+    {
+    case stop_signal:
+        PrintDebug(L"Shutdown: %s did not exit on signal -- setting exit event", s->c->config_name);
+        if (s->exit_event)
+            SetEvent(s->exit_event);
+        s->step = stop_event;
+        s->deadline = now + SHUTDOWN_EVENT_TIMEOUT;
+        break;
+
+    case stop_event:
+        if (s->process)
+        {
+            PrintDebug(L"Shutdown: %s did not exit on exit event -- terminating", s->c->config_name);
+            TerminateProcess(s->process, 1);
+        }
+        s->step = stop_kill;
+        s->deadline = now + SHUTDOWN_KILL_TIMEOUT;
+        break;
+
+    default:
+        /* Not waited for again by a later StartShutdown */
+        PrintDebug(L"Shutdown: giving up on %s", s->c->config_name);
+        InterlockedExchange(&coordinator.given_up[s->c - o.conn], 1);
+        s->step = stop_done;
+        break;
+    }
+}
+
+static DWORD WINAPI
+ShutdownThread(UNUSED void *p)
+{
+    HANDLE wait[MAXIMUM_WAIT_OBJECTS];
+    int i, n, left;
+
+    for (;;)
+    {
+        ULONGLONG now = GetTickCount64(), next = ULLONG_MAX;
+        DWORD timeout, res;
+
+        /* Collect the connections still running and the nearest deadline */
+        n = left = 0;
+        for (i = 0; i < coordinator.count; i++)
+        {
+            stopping_t *s = &coordinator.conn[i];
+            HANDLE h = s->process ? s->process : s->done;
+
+            if (s->step == stop_done)
+                continue;
+            if (WaitForSingleObject(h, 0) == WAIT_OBJECT_0)
+            {
+                PrintDebug(L"Shutdown: %s stopped after %I64u ms", s->c->config_name, now - coordinator.start);
+                s->step = stop_done;
+                continue;
+            }
+            if (now >= s->deadline)
+                Escalate(s, now);
+            if (s->step == stop_done)
+                continue;
+
+            left++;
+            next = min(next, s->deadline);
+            if (n < MAXIMUM_WAIT_OBJECTS)
+                wait[n++] = h;
+        }
+        if (left == 0)
+            break;
+
+        /* Connections that do not fit into one wait are polled */
+        timeout = (DWORD) (next - now);
+        if (left > n)
+            timeout = min(timeout, 100);
+        res = WaitForMultipleObjects(n, wait, FALSE, timeout);
+        if (res == WAIT_FAILED)
+            Sleep(100);
+    }
+
+    PrintDebug(L"Shutdown: all connections stopped in %I64u ms", GetTickCount64() - coordinator.start);
+
+    AcquireSRWLockExclusive(&coordinator.lock);
+    coordinator.active = FALSE;
+    ReleaseSRWLockExclusive(&coordinator.lock);
+
+    for (i = 0; i < coordinator.count; i++)
+    {
+        stopping_t *s = &coordinator.conn[i];
+        CloseHandle(s->done);
+        if (s->process)
+            CloseHandle(s->process);
+        if (s->exit_event)
+            CloseHandle(s->exit_event);
+    }
+
+    if (coordinator.hwnd)
+        PostMessage(coordinator.hwnd, WM_SHUTDOWN, 0, 0);
+    return 0;
+}
+
+/*
+ * Ask all running connections to stop. The thread tracking them notifies
+ * hwnd with WM_SHUTDOWN, if not NULL, once the last one is down. Returns
+ * FALSE if there is nothing to stop. Calling it again while a shutdown
+ * is in progress only changes the window notified. Connections given up
+ * on by an earlier shutdown are not waited for again.
+ */
+BOOL
+StartShutdown(HWND hwnd)
+{
+    ULONGLONG now = GetTickCount64();
+    int i;
+
+    if (coordinator.thread)
+    {
+        if (WaitForSingleObject(coordinator.thread, 0) != WAIT_OBJECT_0)
+        {
+            coordinator.hwnd = hwnd;
+            return TRUE;
+        }
+        CloseHandle(coordinator.thread);
+        coordinator.thread = NULL;
+    }
+
+    coordinator.count = 0;
+    coordinator.start = now;
+    coordinator.hwnd = hwnd;
+
+    for (i = 0; i < o.num_configs; i++)
+    {
+        connection_t *c = &o.conn[i];
+        stopping_t *s = &coordinator.conn[coordinator.count];
+
+        /* Suspended connections have no OpenVPN running */
+        if (c->state == disconnected || c->state == suspended || !c->hwndStatus
+            || coordinator.given_up[i])
+            continue;
+
+        s->done = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (s->done == NULL)
+            continue;
+        s->c = c;
+        s->process = DuplicateLocal(c->hProcess);
+        s->exit_event = DuplicateLocal(c->exit_event);
+
+        /* Without the management interface go straight to the exit event */
+        if (c->manage.ready)
+        {
+            s->step = stop_signal;
+            s->deadline = now + SHUTDOWN_SIGNAL_TIMEOUT;
+        }
+        else
+        {
+            if (s->exit_event)
+                SetEvent(s->exit_event);
+            s->step = stop_event;
+            s->deadline = now + SHUTDOWN_EVENT_TIMEOUT;
+        }
+        coordinator.count++;
+    }
+    if (coordinator.count == 0)
+        return FALSE;
+
+    AcquireSRWLockExclusive(&coordinator.lock);
+    coordinator.active = TRUE;
+    ReleaseSRWLockExclusive(&coordinator.lock);
+
+    for (i = 0; i < coordinator.count; i++)
+        ShutdownOpenVPN(coordinator.conn[i].c);
+
+    coordinator.thread = CreateThread(NULL, 0, ShutdownThread, NULL, 0, NULL);
+    if (coordinator.thread == NULL)
+    {
+        /* Run it here, blocking, rather than not at all */
+        ShutdownThread(NULL);
+    }
+    return TRUE;
+}
+
+/*
+ * Wait until the shutdown is complete. Returns FALSE on timeout.
+ */
+BOOL
+WaitShutdown(DWORD timeout)
+{
+    return (coordinator.thread == NULL
+            || WaitForSingleObject(coordinator.thread, timeout) != WAIT_TIMEOUT);
+}
+
+/*
+ * Called when the OpenVPN process of a connection is gone
+ */
+void
+ShutdownSettled(connection_t *c)
+{
+    int i;
+
+    InterlockedExchange(&coordinator.given_up[c - o.conn], 0);
+
+    AcquireSRWLockShared(&coordinator.lock);
+    if (coordinator.active)
+    {
+        for (i = 0; i < coordinator.count; i++)
+        {
+            if (coordinator.conn[i].c == c)
+                SetEvent(coordinator.conn[i].done);
+        }
+    }
+    ReleaseSRWLockShared(&coordinator.lock);
+}
@@ -0,0 +1,40 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef SHUTDOWN_H
+#define SHUTDOWN_H
+
+#include <windows.h>
+
+#include "options.h"
+
+/* Posted to the window given to StartShutdown when all connections are down */
+#define WM_SHUTDOWN (WM_APP + 32)
+
+/* Escalation deadlines, in milliseconds after the previous step */
+#define SHUTDOWN_SIGNAL_TIMEOUT 2000    /* management signal -> exit event */
+#define SHUTDOWN_EVENT_TIMEOUT  3000    /* exit event -> terminate */
+#define SHUTDOWN_KILL_TIMEOUT   1000    /* terminate -> give up */
+
+BOOL StartShutdown(HWND hwnd);
+BOOL WaitShutdown(DWORD timeout);
+void ShutdownSettled(connection_t *c);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <shlwapi.h>
+#include <string.h>
+
+#include "main.h"
+#include "stats.h"
+
+#define SAMPLE(bc, n) ((bc)->sample[(n) & (BYTECOUNT_SAMPLES - 1)])
+
+void
+ResetByteCount(bytecount_t *bc)
+{
+    InterlockedExchange(&bc->count, 0);
+}
+
+/*
+ * Add a sample of the total bytes received and sent. A counter going
+ * backwards means the tunnel was restarted, so the ring starts over.
+ */
+void
+AddByteCount(bytecount_t *bc, ULONGLONG rx, ULONGLONG tx)
+{
+    LONG n = bc->count;
+    bytecount_sample_t *s;
+
+    if (n > 0 && (rx < SAMPLE(bc, n - 1).rx || tx < SAMPLE(bc, n - 1).tx))
+    {
+        InterlockedExchange(&bc->count, 0);
+        n = 0;
+    }
+
+    s = &SAMPLE(bc, n);
+    s->tick = GetTickCount();
+    s->rx = rx;
+    s->tx = tx;
+
+    /* Publish the sample */
+    InterlockedExchange(&bc->count, n + 1);
+}
+
+/*
+ * Get the average receive and send rate in bytes/s over the last period
+ * milliseconds, or over the available history if that is shorter.
+ * Returns FALSE if there are not enough samples yet.
+ */
+BOOL
+GetByteCountRate(const bytecount_t *bc, DWORD period, double *rx, double *tx)
+{
+    int retry;
+
+    for (retry = 0; retry < 3; ++retry)
+    {
+        bytecount_sample_t last, first;
+        LONG n, i, oldest;
+
+        n = bc->count;
+        MemoryBarrier();
+        if (n < 2)
+            return FALSE;
+
+        /* The slot after the newest sample may be overwritten next */
+        oldest = (n > BYTECOUNT_SAMPLES - 1 ? n - BYTECOUNT_SAMPLES + 1 : 0);
+
+        last = SAMPLE(bc, n - 1);
+        for (i = n - 2; i > oldest; --i)
+        {
+            if (last.tick - SAMPLE(bc, i).tick >= period)
+                break;
+        }
+        first = SAMPLE(bc, i);
+
+        MemoryBarrier();
+        if (bc->count != n)
+            continue;
+
+        if (last.tick == first.tick)
+            return FALSE;
+
+        *rx = (double) (last.rx - first.rx) * 1000 / (last.tick - first.tick);
+        *tx = (double) (last.tx - first.tx) * 1000 / (last.tick - first.tick);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Format a rate in bytes/s as a localized size string, e.g. "1.25 MB"
+ */
+void
+FormatByteRate(double rate, WCHAR *buf, UINT size)
+{
+    if (!StrFormatByteSizeW((LONGLONG) rate, buf, size))
+        __sntprintf_0(buf, size, L"%.0f", rate);
+}
+
+/*
+ * Format a duration in milliseconds, e.g. "850 ms" or "2.4 s"
+ */
+void
+FormatLatency(DWORD ms, WCHAR *buf, UINT size)
+{
+    if (ms < 1000)
+        __sntprintf_0(buf, size, L"%lu ms", ms);
+    else
+        __sntprintf_0(buf, size, L"%.1f s", ms / 1000.0);
+}
+
+/*
+ * Bucket of a duration: exact below 16 ms, then the top three bits
+ */
+static unsigned int
+LatencyBucket(DWORD ms)
+{
+    unsigned int e;
+
+    if (ms < 16)
+        return ms;
+    for (e = 4; e < 31 && (ms >> (e + 1)); ++e)
+        ;
+    return 16 + (e - 4) * 4 + ((ms >> (e - 2)) & 3);
+}
+
+/*
+ * Largest duration falling into a bucket
+ */
+static DWORD
+LatencyBucketMax(unsigned int bucket)
+{
+    unsigned int e, sub;
+
+    if (bucket < 16)
+        return bucket;
+    e = (bucket - 16) / 4 + 4;
+    sub = (bucket - 16) % 4;
+    return (DWORD) (((ULONGLONG) (4 + sub + 1) << (e - 2)) - 1);
+}
+
+void
+AddLatency(latency_hist_t *h, DWORD ms)
+{
+    h->bucket[LatencyBucket(ms)]++;
+    h->count++;
+}
+
+/*
+ * Duration below which percent of the durations in the histogram are,
+ * rounded up to the bucket boundary. Returns 0 if the histogram is empty.
+ */
+DWORD
+LatencyPercentile(const latency_hist_t *h, unsigned int percent)
+{
+    ULONGLONG rank, n = 0;
+    unsigned int i;
+
+    if (h->count == 0)
+        return 0;
+
+    /* Rank of the sample, counting from 1 */
+    rank = ((ULONGLONG) h->count * percent + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+
+    for (i = 0; i < LATENCY_BUCKETS; ++i)
+    {
+        n += h->bucket[i];
+        if (n >= rank)
+            return LatencyBucketMax(i);
+    }
+    return LatencyBucketMax(LATENCY_BUCKETS - 1);
+}
+
+static const struct {
+    const char *state;
+    const WCHAR *name;
+} connect_phases[connect_phase_max] = {
+    [phase_start]        = { NULL,           L"START" },
+    [phase_resolve]      = { "RESOLVE",      L"RESOLVE" },
+    [phase_tcp_connect]  = { "TCP_CONNECT",  L"TCP_CONNECT" },
+    [phase_wait]         = { "WAIT",         L"WAIT" },
+    [phase_auth]         = { "AUTH",         L"AUTH" },
+    [phase_auth_pending] = { "AUTH_PENDING", L"AUTH_PENDING" },
+    [phase_get_config]   = { "GET_CONFIG",   L"GET_CONFIG" },
+    [phase_assign_ip]    = { "ASSIGN_IP",    L"ASSIGN_IP" },
+    [phase_add_routes]   = { "ADD_ROUTES",   L"ADD_ROUTES" },
+};
+
+const WCHAR *
+ConnectPhaseName(connect_phase_t phase)
+{
+    return (phase < connect_phase_max) ? connect_phases[phase].name : L"?";
+}
+
+/*
+ * Start timing a connection attempt, when the GUI starts OpenVPN or
+ * OpenVPN reports it is reconnecting
+ */
+void
+StartConnectAttempt(connect_stats_t *cs)
+{
+    cs->start = cs->since = GetTickCount64();
+    cs->current = phase_start;
+    cs->seen = 1 << phase_start;
+    ZeroMemory(cs->ms, sizeof(cs->ms));
+}
+
+/*
+ * Switch to the phase of an OpenVPN state. States that are not a phase
+ * of connecting, and states reported outside an attempt, are ignored.
+ */
+void
+EnterConnectPhase(connect_stats_t *cs, const char *state)
+{
+    ULONGLONG now;
+    int i;
+
+    if (cs->start == 0)
+        return;
+
+    for (i = phase_start + 1; i < connect_phase_max; ++i)
+    {
+        if (strcmp(state, connect_phases[i].state) == 0)
+            break;
+    }
+    if (i == connect_phase_max)
+        return;
+
+    now = GetTickCount64();
+    cs->ms[cs->current] += (DWORD) (now - cs->since);
+    cs->since = now;
+    cs->current = i;
+    cs->seen |= 1 << i;
+}
+
+/*
+ * Finish the current attempt as connected and add its durations to the
+ * histograms. The time in each phase is left in cs->ms. Returns FALSE if
+ * no attempt was being timed.
+ */
+BOOL
+EndConnectAttempt(connect_stats_t *cs, DWORD *total)
+{
+    ULONGLONG now = GetTickCount64();
+    int i;
+
+    if (cs->start == 0)
+        return FALSE;
+
+    cs->ms[cs->current] += (DWORD) (now - cs->since);
+    *total = (DWORD) (now - cs->start);
+    cs->start = 0;
+
+    AddLatency(&cs->total, *total);
+    for (i = 0; i < connect_phase_max; ++i)
+    {
+        if (cs->seen & (1 << i))
+            AddLatency(&cs->phase[i], cs->ms[i]);
+    }
+    return TRUE;
+}
@@ -0,0 +1,108 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <windows.h>
+
+/* Windows over which throughput is averaged, in milliseconds */
+#define BYTECOUNT_RATE_NOW      1000
+#define BYTECOUNT_RATE_SHORT    10000
+#define BYTECOUNT_RATE_LONG     60000
+
+/*
+ * Number of byte count samples kept, must be a power of 2. With one
+ * sample a second ('bytecount 1') this covers the longest window twice
+ * over, leaving slack for samples that arrive in bursts.
+ */
+#define BYTECOUNT_SAMPLES 256
+
+typedef struct {
+    DWORD tick;                     /* GetTickCount() when received */
+    ULONGLONG rx;                   /* total bytes received */
+    ULONGLONG tx;                   /* total bytes sent */
+} bytecount_sample_t;
+
+/*
+ * Ring of byte count samples. It is written by the thread handling the
+ * management interface only and may be read from any thread without
+ * locking: count is updated after the sample is in place and readers
+ * retry if it changed while they were reading.
+ */
+typedef struct {
+    bytecount_sample_t sample[BYTECOUNT_SAMPLES];
+    volatile LONG count;            /* # of samples written */
+} bytecount_t;
+
+/*
+ * Histogram of durations in milliseconds. Durations below 16 ms have a
+ * bucket each, longer ones four buckets per power of two, so that a
+ * percentile is off by at most 25%.
+ */
+#define LATENCY_BUCKETS 128
+
+typedef struct {
+    unsigned int count;
+    unsigned int bucket[LATENCY_BUCKETS];
+} latency_hist_t;
+
+/* Phases of a connection attempt, as reported in OpenVPN state notifications */
+typedef enum {
+    phase_start,            /* until the first state is reported */
+    phase_resolve,
+    phase_tcp_connect,
+    phase_wait,
+    phase_auth,
+    phase_auth_pending,
+    phase_get_config,
+    phase_assign_ip,
+    phase_add_routes,
+    connect_phase_max
+} connect_phase_t;
+
+/*
+ * Time spent in each phase of the current connection attempt and
+ * histograms over all successful attempts of a connection. Only used
+ * by the thread handling the management interface.
+ */
+typedef struct {
+    ULONGLONG start;                        /* tick when the attempt started, 0 if none */
+    ULONGLONG since;                        /* tick when the current phase was entered */
+    connect_phase_t current;
+    DWORD seen;                             /* bit mask of the phases entered */
+    DWORD ms[connect_phase_max];            /* time spent in each phase */
+    latency_hist_t total;                   /* time to connect */
+    latency_hist_t phase[connect_phase_max];
+} connect_stats_t;
+
+void ResetByteCount(bytecount_t *bc);
+void AddByteCount(bytecount_t *bc, ULONGLONG rx, ULONGLONG tx);
+BOOL GetByteCountRate(const bytecount_t *bc, DWORD period, double *rx, double *tx);
+void FormatByteRate(double rate, WCHAR *buf, UINT size);
+
+void FormatLatency(DWORD ms, WCHAR *buf, UINT size);
+void AddLatency(latency_hist_t *h, DWORD ms);
+DWORD LatencyPercentile(const latency_hist_t *h, unsigned int percent);
+void StartConnectAttempt(connect_stats_t *cs);
+void EnterConnectPhase(connect_stats_t *cs, const char *state);
+BOOL EndConnectAttempt(connect_stats_t *cs, DWORD *total);
+const WCHAR *ConnectPhaseName(connect_phase_t phase);
+
+#endif
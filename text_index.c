@@ -0,0 +1,311 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "text_index.h"
+
+/*
+ * Fold case the same way for indexing, queries and matching
+ */
+static WCHAR
+FoldChar(WCHAR ch)
+{
+    if (ch < 0x80)
+        return (ch >= L'A' && ch <= L'Z') ? ch + (L'a' - L'A') : ch;
+    return (WCHAR) (ULONG_PTR) CharLowerW((WCHAR *) (ULONG_PTR) ch);
+}
+
+static DWORD
+TrigramBucket(WCHAR a, WCHAR b, WCHAR c)
+{
+    DWORD h = a * 0x9E3779B1u ^ b * 0x85EBCA77u ^ c * 0xC2B2AE3Du;
+    return (h ^ (h >> 15)) & (TEXT_INDEX_BUCKETS - 1);
+}
+
+void
+TextIndexInit(text_index_t *ti)
+{
+    CLEAR(*ti);
+    InitializeSRWLock(&ti->lock);
+}
+
+static void
+FreeBuckets(text_index_t *ti)
+{
+    size_t i;
+
+    if (ti->bucket)
+    {
+        for (i = 0; i < TEXT_INDEX_BUCKETS; ++i)
+            free(ti->bucket[i].block);
+        free(ti->bucket);
+    }
+    ti->bucket = NULL;
+    ti->first = 0;
+    ti->postings = 0;
+    ti->incomplete = FALSE;
+}
+
+void
+TextIndexFree(text_index_t *ti)
+{
+    FreeBuckets(ti);
+    CLEAR(*ti);
+}
+
+/*
+ * Drop all lines, e.g., when the log file was truncated
+ */
+void
+TextIndexClear(text_index_t *ti)
+{
+    AcquireSRWLockExclusive(&ti->lock);
+    FreeBuckets(ti);
+    ReleaseSRWLockExclusive(&ti->lock);
+}
+
+/*
+ * Add block to a posting list. Entries of blocks that expired are
+ * dropped before the list is grown.
+ */
+static BOOL
+AddPosting(text_index_t *ti, text_posting_t *p, DWORD block)
+{
+    if (p->count && p->block[p->count - 1] == block)
+        return TRUE;
+
+    if (p->count == p->size && p->count && p->block[0] < ti->first)
+    {
+        DWORD lo = 0, hi = p->count;
+        while (lo < hi)
+        {
+            DWORD mid = lo + (hi - lo) / 2;
+            if (p->block[mid] < ti->first)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        memmove(p->block, p->block + lo, (p->count - lo) * sizeof(*p->block));
+        p->count -= lo;
+        ti->postings -= lo;
+    }
+
+    if (ti->postings >= TEXT_INDEX_MAX_POSTINGS)
+        return FALSE;
+
+    if (p->count == p->size)
+    {
+        DWORD size = p->size ? p->size * 2 : 4;
+        DWORD *b = realloc(p->block, size * sizeof(*b));
+        if (b == NULL)
+            return FALSE;
+        p->block = b;
+        p->size = size;
+    }
+
+    p->block[p->count++] = block;
+    ti->postings++;
+    return TRUE;
+}
+
+/*
+ * Index the trigrams of a line
+ */
+void
+TextIndexAdd(text_index_t *ti, ULONGLONG line, const WCHAR *text, size_t len)
+{
+    DWORD block = (DWORD) (line / TEXT_INDEX_BLOCK);
+    WCHAR a, b, c;
+    size_t i;
+
+    if (len < 3)
+        return;
+
+    AcquireSRWLockExclusive(&ti->lock);
+    if (ti->bucket == NULL && !ti->incomplete)
+    {
+        ti->bucket = calloc(TEXT_INDEX_BUCKETS, sizeof(*ti->bucket));
+        ti->incomplete = (ti->bucket == NULL);
+    }
+    if (ti->incomplete)
+        goto out;
+
+    a = FoldChar(text[0]);
+    b = FoldChar(text[1]);
+    for (i = 2; i < len; ++i, a = b, b = c)
+    {
+        c = FoldChar(text[i]);
+        if (!AddPosting(ti, &ti->bucket[TrigramBucket(a, b, c)], block))
+        {
+            /* Release the memory of an index that can't be used */
+            PrintDebug(L"Text index dropped at %Iu list entries", ti->postings);
+            FreeBuckets(ti);
+            ti->incomplete = TRUE;
+            break;
+        }
+    }
+
+out:
+    ReleaseSRWLockExclusive(&ti->lock);
+}
+
+/*
+ * Stop searching lines before first. Their list entries are dropped
+ * when lists need to grow.
+ */
+void
+TextIndexExpire(text_index_t *ti, ULONGLONG first)
+{
+    AcquireSRWLockExclusive(&ti->lock);
+    ti->first = (DWORD) (first / TEXT_INDEX_BLOCK);
+    ReleaseSRWLockExclusive(&ti->lock);
+}
+
+static BOOL
+HasBlock(const text_posting_t *p, DWORD block)
+{
+    DWORD lo = 0, hi = p->count;
+
+    while (lo < hi)
+    {
+        DWORD mid = lo + (hi - lo) / 2;
+        if (p->block[mid] < block)
+            lo = mid + 1;
+        else if (p->block[mid] > block)
+            hi = mid;
+        else
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Find the blocks that may have lines containing query. On success
+ * blocks is set to an ascending array of count block numbers that the
+ * caller has to free. Returns FALSE if the index can't be used for this
+ * query and all lines have to be searched.
+ */
+BOOL
+TextIndexQuery(text_index_t *ti, const WCHAR *query, DWORD **blocks, size_t *count)
+{
+    const text_posting_t *list[64];
+    size_t nlist = 0, len = wcslen(query);
+    size_t i, j, n = 0;
+    const text_posting_t *shortest;
+    DWORD *found = NULL;
+    BOOL ret = FALSE;
+
+    *blocks = NULL;
+    *count = 0;
+    if (len < 3)
+        return FALSE;
+
+    AcquireSRWLockShared(&ti->lock);
+    if (ti->incomplete)
+        goto out;
+    ret = TRUE;
+    if (ti->bucket == NULL)
+        goto out;
+
+    for (i = 0; i + 2 < len && nlist < _countof(list); ++i)
+    {
+        const text_posting_t *p = &ti->bucket[TrigramBucket(FoldChar(query[i]),
+                                                             FoldChar(query[i + 1]),
+                                                             FoldChar(query[i + 2]))];
+        for (j = 0; j < nlist && list[j] != p; ++j)
+            ;
+        if (j == nlist)
+            list[nlist++] = p;
+    }
+
+    shortest = list[0];
+    for (i = 1; i < nlist; ++i)
+    {
+        if (list[i]->count < shortest->count)
+            shortest = list[i];
+    }
+    if (shortest->count == 0)
+        goto out;
+
+    found = malloc(shortest->count * sizeof(*found));
+    if (found == NULL)
+    {
+        ret = FALSE;
+        goto out;
+    }
+
+    for (i = 0; i < shortest->count; ++i)
+    {
+        DWORD block = shortest->block[i];
+        if (block < ti->first)
+            continue;
+        for (j = 0; j < nlist; ++j)
+        {
+            if (list[j] != shortest && !HasBlock(list[j], block))
+                break;
+        }
+        if (j == nlist)
+            found[n++] = block;
+    }
+
+out:
+    ReleaseSRWLockShared(&ti->lock);
+    if (n)
+    {
+        *blocks = found;
+        *count = n;
+    }
+    else
+    {
+        free(found);
+    }
+    return ret;
+}
+
+/*
+ * Check if text contains query, ignoring case
+ */
+BOOL
+TextMatch(const WCHAR *text, const WCHAR *query)
+{
+    size_t i, j;
+
+    if (*query == L'\0')
+        return TRUE;
+
+    for (i = 0; text[i]; ++i)
+    {
+        for (j = 0; query[j] && text[i + j]; ++j)
+        {
+            if (FoldChar(text[i + j]) != FoldChar(query[j]))
+                break;
+        }
+        if (query[j] == L'\0')
+            return TRUE;
+    }
+    return FALSE;
+}
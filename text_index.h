@@ -0,0 +1,64 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef TEXT_INDEX_H
+#define TEXT_INDEX_H
+
+#include <windows.h>
+
+/* # of consecutive lines sharing an entry in the posting lists */
+#define TEXT_INDEX_BLOCK    32
+
+/* # of trigram hash buckets, a power of 2 */
+#define TEXT_INDEX_BUCKETS  16384
+
+/* Max # of list entries (64 MB). Past that the index is dropped and
+ * queries fall back to looking at every line. */
+#define TEXT_INDEX_MAX_POSTINGS (16 * 1024 * 1024)
+
+typedef struct {
+    DWORD *block;           /* ascending block numbers */
+    DWORD count;
+    DWORD size;
+} text_posting_t;
+
+/*
+ * Trigram index for case insensitive substring search in numbered
+ * lines. Each hash bucket lists the blocks of TEXT_INDEX_BLOCK lines that
+ * contain one of its trigrams, so a query only has to look at the lines
+ * of blocks found in the lists of all its trigrams. Lines have to be
+ * added in ascending order.
+ */
+typedef struct {
+    SRWLOCK lock;
+    text_posting_t *bucket; /* allocated with the first line */
+    DWORD first;            /* oldest block still searched */
+    size_t postings;        /* total # of list entries */
+    BOOL incomplete;        /* out of memory or too large, queries can't use the index */
+} text_index_t;
+
+void TextIndexInit(text_index_t *ti);
+void TextIndexFree(text_index_t *ti);
+void TextIndexClear(text_index_t *ti);
+void TextIndexAdd(text_index_t *ti, ULONGLONG line, const WCHAR *text, size_t len);
+void TextIndexExpire(text_index_t *ti, ULONGLONG first);
+BOOL TextIndexQuery(text_index_t *ti, const WCHAR *query, DWORD **blocks, size_t *count);
+BOOL TextMatch(const WCHAR *text, const WCHAR *query);
+
+#endif
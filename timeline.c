@@ -0,0 +1,634 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <commctrl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "main.h"
+#include "options.h"
+#include "openvpn.h"
+#include "openvpn-gui-res.h"
+#include "localization.h"
+#include "log_model.h"
+#include "log_index.h"
+#include "misc.h"
+#include "log_time.h"
+#include "timeline.h"
+
+extern options_t o;
+
+/* Lines merged per timer tick, keeps the window responsive */
+#define TIMELINE_BATCH      20000
+#define TIMELINE_TICK       10
+#define TIMELINE_READ_SIZE  65536
+
+#define IDT_TIMELINE        1
+
+/* A line of the timeline */
+typedef struct {
+    time_t timestamp;
+    ULONGLONG pos;          /* record number or file offset of the line */
+    WORD source;
+    WORD flags;
+    BOOL record;            /* pos is a record number of the model */
+} timeline_row_t;
+
+/*
+ * Lines of one connection in time order: the lines of its log file read
+ * in chunks up to the time of the first record of its log model, then
+ * the records of the model.
+ */
+typedef struct {
+    WCHAR config_name[MAX_PATH];
+    log_model_t *model;
+    ULONGLONG next;         /* next record of the model */
+    ULONGLONG end;          /* end of the model when the timeline was built */
+    time_t model_since;     /* time of the first record of the model */
+    HANDLE file;
+    BOOL file_done;         /* the rest of the file is in the model */
+    char *buf;              /* chunk of the file */
+    size_t len;             /* bytes in buf */
+    size_t start;           /* start of the next line in buf */
+    ULONGLONG offset;       /* file offset of buf */
+    BOOL eof;
+    time_t last;            /* time of the previous line */
+    timeline_row_t head;    /* next line to be merged */
+} timeline_source_t;
+
+typedef struct {
+    HWND hwnd;
+    timeline_source_t source[MAX_CONFIGS];
+    int nsources;
+    int heap[MAX_CONFIGS];  /* sources with lines left, earliest head first */
+    int nheap;
+    timeline_row_t *rows;
+    size_t nrows;
+    size_t rows_size;
+    struct {
+        int year, mon, mday;
+        time_t midnight;
+    } date;                 /* last date parsed from a log file */
+} timeline_t;
+
+static volatile LONG timeline_open;
+static HWND timeline_hwnd;
+
+static BOOL
+ReadAt(HANDLE file, ULONGLONG offset, char *buf, size_t size, size_t *read)
+{
+    OVERLAPPED ov;
+    DWORD n = 0;
+
+    CLEAR(ov);
+    ov.Offset = (DWORD) offset;
+    ov.OffsetHigh = (DWORD) (offset >> 32);
+    if (!ReadFile(file, buf, (DWORD) size, &n, &ov))
+        n = 0;
+    *read = n;
+    return (n > 0);
+}
+
+/*
+ * Parse the time at the start of a line of an OpenVPN log file, either
+ * "2016-10-13 10:00:00" or "Thu Oct 13 10:00:00 2016". Returns the # of
+ * characters used or 0 if the line does not start with a time.
+ */
+static size_t
+ParseLogTime(timeline_t *tl, const char *line, size_t len, time_t *t)
+{
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char buf[32], mon[4];
+    const char *m;
+    int year, month, mday, hour, min, sec, n = 0;
+
+    len = min(len, sizeof(buf) - 1);
+    memcpy(buf, line, len);
+    buf[len] = '\0';
+
+    if (sscanf(buf, "%4d-%2d-%2d %2d:%2d:%2d %n", &year, &month, &mday, &hour, &min, &sec, &n) == 6 && n)
+        ;
+    else if (sscanf(buf, "%*3s %3s %d %d:%d:%d %d %n", mon, &mday, &hour, &min, &sec, &year, &n) == 6 && n
+             && (m = strstr(months, mon)) != NULL && (m - months) % 3 == 0)
+        month = (m - months) / 3 + 1;
+    else
+        return 0;
+
+    /* Lines of a log file mostly share the date, mktime() it once */
+    if (year != tl->date.year || month != tl->date.mon || mday != tl->date.mday)
+    {
+        struct tm tm;
+        CLEAR(tm);
+        tm.tm_year = year - 1900;
+        tm.tm_mon = month - 1;
+        tm.tm_mday = mday;
+        tm.tm_isdst = -1;
+        tl->date.midnight = mktime(&tm);
+        tl->date.year = year;
+        tl->date.mon = month;
+        tl->date.mday = mday;
+    }
+    if (tl->date.midnight == (time_t) -1)
+        return 0;
+
+    *t = tl->date.midnight + hour * 3600 + min * 60 + sec;
+    return n;
+}
+
+/*
+ * Get the next record of the model of a source into its head
+ */
+static BOOL
+NextRecord(timeline_source_t *s, int i)
+{
+    log_record_t rec;
+
+    while (s->next < s->end)
+    {
+        ULONGLONG rn = s->next++;
+        if (LogModelGet(s->model, rn, &rec, NULL, 0))
+        {
+            s->head.timestamp = rec.timestamp;
+            s->head.pos = rn;
+            s->head.source = (WORD) i;
+            s->head.flags = rec.flags;
+            s->head.record = TRUE;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Get the next line of the log file of a source into its head
+ */
+static BOOL
+NextFileLine(timeline_t *tl, timeline_source_t *s, int i)
+{
+    const char *line, *eol;
+    size_t len, n;
+    time_t t;
+
+    for (;;)
+    {
+        eol = memchr(s->buf + s->start, '\n', s->len - s->start);
+        if (eol || s->eof)
+            break;
+        if (s->start == 0 && s->len == TIMELINE_READ_SIZE)
+        {
+            /* Overlong line, cut it at the end of the buffer */
+            eol = s->buf + s->len - 1;
+            break;
+        }
+
+        /* Keep the incomplete line and read the next chunk */
+        memmove(s->buf, s->buf + s->start, s->len - s->start);
+        s->offset += s->start;
+        s->len -= s->start;
+        s->start = 0;
+        if (!ReadAt(s->file, s->offset + s->len, s->buf + s->len, TIMELINE_READ_SIZE - s->len, &n))
+            s->eof = TRUE;
+        s->len += n;
+    }
+
+    if (s->start == s->len)
+        return FALSE;
+
+    line = s->buf + s->start;
+    len = eol ? (size_t) (eol - line) + 1 : s->len - s->start;
+
+    /* Lines without a time, e.g. continuation lines, stay after the previous one */
+    if (ParseLogTime(tl, line, len, &t))
+        s->last = t;
+    s->head.timestamp = s->last;
+    s->head.pos = s->offset + s->start;
+    s->head.source = (WORD) i;
+    s->head.flags = LogIndexGuessFlags(line, len);
+    s->head.record = FALSE;
+    s->start += len;
+    return TRUE;
+}
+
+/*
+ * Get the next line of a source into its head. Returns FALSE if there
+ * are no more lines.
+ */
+static BOOL
+NextLine(timeline_t *tl, int i)
+{
+    timeline_source_t *s = &tl->source[i];
+
+    /* Lines of the log file older than the model, then the model */
+    if (s->file && !s->file_done)
+    {
+        if (NextFileLine(tl, s, i) && (!s->model || s->head.timestamp < s->model_since))
+            return TRUE;
+        s->file_done = TRUE;
+    }
+    return (s->model && NextRecord(s, i));
+}
+
+static BOOL
+HeadBefore(timeline_t *tl, int a, int b)
+{
+    const timeline_row_t *ha = &tl->source[a].head;
+    const timeline_row_t *hb = &tl->source[b].head;
+
+    /* Equal times keep the order of the connections */
+    if (ha->timestamp != hb->timestamp)
+        return ha->timestamp < hb->timestamp;
+    return a < b;
+}
+
+static void
+SiftDown(timeline_t *tl, int i)
+{
+    for (;;)
+    {
+        int l = 2 * i + 1, r = l + 1, m = i, tmp;
+        if (l < tl->nheap && HeadBefore(tl, tl->heap[l], tl->heap[m]))
+            m = l;
+        if (r < tl->nheap && HeadBefore(tl, tl->heap[r], tl->heap[m]))
+            m = r;
+        if (m == i)
+            break;
+        tmp = tl->heap[i];
+        tl->heap[i] = tl->heap[m];
+        tl->heap[m] = tmp;
+        i = m;
+    }
+}
+
+static void
+CloseTimeline(timeline_t *tl)
+{
+    int i;
+
+    for (i = 0; i < tl->nsources; ++i)
+    {
+        if (tl->source[i].file)
+            CloseHandle(tl->source[i].file);
+        free(tl->source[i].buf);
+    }
+    free(tl->rows);
+    tl->nsources = tl->nheap = 0;
+    tl->rows = NULL;
+    tl->nrows = tl->rows_size = 0;
+}
+
+/*
+ * Set up a source for each connection with log lines
+ */
+static void
+OpenTimeline(timeline_t *tl)
+{
+    ULONGLONG first, next;
+    log_record_t rec;
+    int i;
+
+    CloseTimeline(tl);
+    for (i = 0; i < o.num_configs; ++i)
+    {
+        connection_t *c = &o.conn[i];
+        timeline_source_t *s = &tl->source[tl->nsources];
+
+        CLEAR(*s);
+        wcsncpy(s->config_name, c->config_name, _countof(s->config_name) - 1);
+        LogModelRange(&c->log, &first, &next);
+        if (next > first && LogModelGet(&c->log, first, &rec, NULL, 0))
+        {
+            s->model = &c->log;
+            s->next = first;
+            s->end = next;
+            s->model_since = rec.timestamp;
+        }
+
+        s->file = CreateFile(c->log_path, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                             NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (s->file == INVALID_HANDLE_VALUE)
+            s->file = NULL;
+        else if ((s->buf = malloc(TIMELINE_READ_SIZE)) == NULL)
+        {
+            CloseHandle(s->file);
+            s->file = NULL;
+        }
+        if (!s->model && !s->file)
+            continue;
+
+        tl->nsources++;
+        if (NextLine(tl, tl->nsources - 1))
+            tl->heap[tl->nheap++] = tl->nsources - 1;
+    }
+
+    for (i = tl->nheap / 2 - 1; i >= 0; --i)
+        SiftDown(tl, i);
+}
+
+/*
+ * Move up to max lines from the sources to the timeline. Returns FALSE
+ * when all lines have been merged.
+ */
+static BOOL
+MergeTimeline(timeline_t *tl, size_t max)
+{
+    while (tl->nheap > 0 && max--)
+    {
+        int i = tl->heap[0];
+
+        if (tl->nrows == tl->rows_size)
+        {
+            size_t size = max(tl->rows_size * 2, (size_t) 65536);
+            timeline_row_t *rows = realloc(tl->rows, size * sizeof(*rows));
+            if (rows == NULL)
+            {
+                PrintDebug(L"Timeline: out of memory after %Iu lines", tl->nrows);
+                tl->nheap = 0;
+                break;
+            }
+            tl->rows = rows;
+            tl->rows_size = size;
+        }
+        tl->rows[tl->nrows++] = tl->source[i].head;
+
+        if (!NextLine(tl, i))
+            tl->heap[0] = tl->heap[--tl->nheap];
+        SiftDown(tl, 0);
+    }
+    return (tl->nheap > 0);
+}
+
+/*
+ * Get the message of a timeline row
+ */
+static void
+FormatTimelineRow(timeline_t *tl, const timeline_row_t *row, WCHAR *buf, size_t size)
+{
+    timeline_source_t *s = &tl->source[row->source];
+    char line[MAX_LOG_LENGTH];
+    WCHAR wide[MAX_LOG_LENGTH];
+    log_record_t rec;
+    size_t len, skip;
+    time_t t;
+    int n;
+
+    buf[0] = L'\0';
+    if (row->record)
+    {
+        LogModelGet(s->model, row->pos, &rec, buf, size);
+        return;
+    }
+
+    if (!ReadAt(s->file, row->pos, line, sizeof(line), &len))
+        return;
+    for (n = 0; (size_t) n < len && line[n] != '\n' && line[n] != '\r'; ++n)
+        ;
+    skip = ParseLogTime(tl, line, n, &t);
+
+    /* Converting fails if buf is too small, truncate a copy instead */
+    n = MultiByteToWideChar(CP_UTF8, 0, line + skip, n - (int) skip, wide, _countof(wide));
+    n = min(n, (int) size - 1);
+    wmemcpy(buf, wide, n);
+    buf[n] = L'\0';
+}
+
+static LRESULT
+OnTimelineNotify(timeline_t *tl, NMHDR *hdr)
+{
+    switch (hdr->code)
+    {
+    case LVN_GETDISPINFO:
+    {
+        LVITEM *item = &((NMLVDISPINFO *) hdr)->item;
+        const timeline_row_t *row;
+
+        if (!(item->mask & LVIF_TEXT) || (size_t) item->iItem >= tl->nrows || item->cchTextMax <= 0)
+            break;
+        row = &tl->rows[item->iItem];
+        if (item->iSubItem == 0)
+            _snwprintf(item->pszText, item->cchTextMax, L"%s", LogTimeString(row->timestamp));
+        else if (item->iSubItem == 1)
+            _snwprintf(item->pszText, item->cchTextMax, L"%s", tl->source[row->source].config_name);
+        else
+            FormatTimelineRow(tl, row, item->pszText, item->cchTextMax);
+        item->pszText[item->cchTextMax - 1] = L'\0';
+        break;
+    }
+
+    case NM_CUSTOMDRAW:
+    {
+        NMLVCUSTOMDRAW *cd = (NMLVCUSTOMDRAW *) hdr;
+        WORD flags;
+
+        if (cd->nmcd.dwDrawStage == CDDS_PREPAINT)
+            return CDRF_NOTIFYITEMDRAW;
+        if (cd->nmcd.dwDrawStage != CDDS_ITEMPREPAINT || cd->nmcd.dwItemSpec >= tl->nrows)
+            break;
+
+        flags = tl->rows[cd->nmcd.dwItemSpec].flags;
+        if (flags & (LOG_FLAG_FATAL|LOG_FLAG_NONFATAL))
+            cd->clrText = o.clr_error;
+        else if (flags & LOG_FLAG_WARN)
+            cd->clrText = o.clr_warning;
+        else
+            break;
+        return CDRF_NEWFONT;
+    }
+    }
+    return CDRF_DODEFAULT;
+}
+
+static void
+UpdateTimeline(timeline_t *tl, BOOL done)
+{
+    WCHAR status[100];
+
+    ListView_SetItemCountEx(GetDlgItem(tl->hwnd, ID_LST_TIMELINE), (int) min(tl->nrows, (size_t) INT_MAX),
+                            LVSICF_NOINVALIDATEALL|LVSICF_NOSCROLL);
+    LoadLocalizedStringBuf(status, _countof(status), (done ? IDS_NFO_TIMELINE_LINES : IDS_NFO_TIMELINE_MERGING),
+                           tl->nrows, tl->nsources);
+    SetDlgItemText(tl->hwnd, ID_TXT_TIMELINE_STATUS, status);
+}
+
+static void
+RenderTimeline(HWND hwndDlg, int w, int h)
+{
+    MoveWindow(GetDlgItem(hwndDlg, ID_LST_TIMELINE), DPI_SCALE(5), DPI_SCALE(5),
+               w - DPI_SCALE(10), h - DPI_SCALE(40), TRUE);
+    MoveWindow(GetDlgItem(hwndDlg, ID_TXT_TIMELINE_STATUS), DPI_SCALE(5), h - DPI_SCALE(28),
+               w - DPI_SCALE(130), DPI_SCALE(15), TRUE);
+    MoveWindow(GetDlgItem(hwndDlg, ID_BTN_TIMELINE_REFRESH), w - DPI_SCALE(115), h - DPI_SCALE(31),
+               DPI_SCALE(110), DPI_SCALE(23), TRUE);
+}
+
+static INT_PTR CALLBACK
+TimelineDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    timeline_t *tl;
+
+    switch (msg)
+    {
+    case WM_INITDIALOG:
+    {
+        tl = (timeline_t *) lParam;
+        tl->hwnd = hwndDlg;
+        timeline_hwnd = hwndDlg;
+        SetProp(hwndDlg, cfgProp, (HANDLE) tl);
+
+        HWND list = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, NULL,
+            WS_CHILD|WS_VISIBLE|WS_TABSTOP|LVS_REPORT|LVS_OWNERDATA|LVS_SHOWSELALWAYS,
+            5, 5, 490, 220, hwndDlg, (HMENU) ID_LST_TIMELINE, o.hInstance, NULL);
+        if (!list)
+        {
+            EndDialog(hwndDlg, FALSE);
+            return TRUE;
+        }
+        ListView_SetExtendedListViewStyle(list, LVS_EX_FULLROWSELECT|LVS_EX_DOUBLEBUFFER);
+        LVCOLUMN col = {
+            .mask = LVCF_WIDTH|LVCF_TEXT,
+            .cx = DPI_SCALE(150),
+            .pszText = LoadLocalizedString(IDS_NFO_TIMELINE_TIME)
+        };
+        ListView_InsertColumn(list, 0, &col);
+        col.cx = DPI_SCALE(100);
+        col.pszText = LoadLocalizedString(IDS_NFO_TIMELINE_CONNECTION);
+        ListView_InsertColumn(list, 1, &col);
+        col.cx = DPI_SCALE(2000);
+        col.pszText = LoadLocalizedString(IDS_NFO_TIMELINE_MESSAGE);
+        ListView_InsertColumn(list, 2, &col);
+        SendMessage(list, WM_SETFONT, SendMessage(hwndDlg, WM_GETFONT, 0, 0), FALSE);
+
+        SendMessage(hwndDlg, WM_SETICON, (WPARAM) ICON_SMALL, (LPARAM) LoadLocalizedSmallIcon(ID_ICO_APP));
+        SendMessage(hwndDlg, WM_SETICON, (WPARAM) ICON_BIG, (LPARAM) LoadLocalizedIcon(ID_ICO_APP));
+
+        OpenTimeline(tl);
+        UpdateTimeline(tl, FALSE);
+        SetTimer(hwndDlg, IDT_TIMELINE, TIMELINE_TICK, NULL);
+        SetFocus(list);
+        return FALSE;
+    }
+
+    case WM_TIMER:
+        tl = (timeline_t *) GetProp(hwndDlg, cfgProp);
+        if (wParam != IDT_TIMELINE)
+            break;
+        if (!MergeTimeline(tl, TIMELINE_BATCH))
+        {
+            KillTimer(hwndDlg, IDT_TIMELINE);
+            UpdateTimeline(tl, TRUE);
+        }
+        else
+            UpdateTimeline(tl, FALSE);
+        return TRUE;
+
+    case WM_SIZE:
+        RenderTimeline(hwndDlg, LOWORD(lParam), HIWORD(lParam));
+        InvalidateRect(hwndDlg, NULL, TRUE);
+        return TRUE;
+
+    case WM_NOTIFY:
+        tl = (timeline_t *) GetProp(hwndDlg, cfgProp);
+        if (((NMHDR *) lParam)->idFrom == ID_LST_TIMELINE)
+        {
+            SetWindowLongPtr(hwndDlg, DWLP_MSGRESULT, OnTimelineNotify(tl, (NMHDR *) lParam));
+            return TRUE;
+        }
+        break;
+
+    case WM_COMMAND:
+        tl = (timeline_t *) GetProp(hwndDlg, cfgProp);
+        switch (LOWORD(wParam))
+        {
+        case ID_BTN_TIMELINE_REFRESH:
+            ListView_SetItemCountEx(GetDlgItem(hwndDlg, ID_LST_TIMELINE), 0, 0);
+            OpenTimeline(tl);
+            UpdateTimeline(tl, FALSE);
+            SetTimer(hwndDlg, IDT_TIMELINE, TIMELINE_TICK, NULL);
+            return TRUE;
+
+        case IDCANCEL:
+            EndDialog(hwndDlg, TRUE);
+            return TRUE;
+        }
+        break;
+
+    case WM_CLOSE:
+        EndDialog(hwndDlg, TRUE);
+        return TRUE;
+
+    case WM_DESTROY:
+        KillTimer(hwndDlg, IDT_TIMELINE);
+        RemoveProp(hwndDlg, cfgProp);
+        break;
+    }
+    return FALSE;
+}
+
+static DWORD WINAPI
+ThreadLogTimeline(void *p)
+{
+    timeline_t *tl = p;
+
+    LocalizedDialogBoxParam(ID_DLG_TIMELINE, TimelineDialogFunc, (LPARAM) tl);
+    CloseTimeline(tl);
+    free(tl);
+    timeline_hwnd = NULL;
+    InterlockedExchange(&timeline_open, 0);
+    return 0;
+}
+
+/*
+ * Show the log lines of all connections merged in time order. Lines
+ * come from the log model of connections that have one, else from
+ * their log file, and are merged a batch at a time.
+ */
+void
+ShowLogTimeline(void)
+{
+    timeline_t *tl;
+    HANDLE thread;
+    HWND hwnd;
+
+    if (InterlockedCompareExchange(&timeline_open, 1, 0) != 0)
+    {
+        if ((hwnd = timeline_hwnd) != NULL)
+        {
+            ShowWindow(hwnd, SW_RESTORE);
+            SetForegroundWindow(hwnd);
+        }
+        return;
+    }
+
+    tl = calloc(1, sizeof(*tl));
+    thread = tl ? CreateThread(NULL, 0, ThreadLogTimeline, tl, 0, NULL) : NULL;
+    if (thread == NULL)
+    {
+        free(tl);
+        InterlockedExchange(&timeline_open, 0);
+        return;
+    }
+    CloseHandle(thread);
+}
@@ -197,6 +197,7 @@ CreatePopupMenus()
 
         AppendMenu(hMenu, MF_SEPARATOR, 0, 0);
 
+        AppendMenu(hMenu, MF_STRING, IDM_TIMELINE, LoadLocalizedString(IDS_MENU_TIMELINE));
         AppendMenu(hMenu, MF_STRING, IDM_IMPORT, LoadLocalizedString(IDS_MENU_IMPORT));
         AppendMenu(hMenu, MF_STRING ,IDM_SETTINGS, LoadLocalizedString(IDS_MENU_SETTINGS));
         AppendMenu(hMenu, MF_STRING ,IDM_CLOSE, LoadLocalizedString(IDS_MENU_CLOSE));
@@ -220,6 +221,7 @@ CreatePopupMenus()
             AppendMenu(hMenu, MF_SEPARATOR, 0, 0);
         }
 
+        AppendMenu(hMenu, MF_STRING, IDM_TIMELINE, LoadLocalizedString(IDS_MENU_TIMELINE));
         AppendMenu(hMenu, MF_STRING, IDM_IMPORT, LoadLocalizedString(IDS_MENU_IMPORT));
         AppendMenu(hMenu, MF_STRING, IDM_SETTINGS, LoadLocalizedString(IDS_MENU_SETTINGS));
         AppendMenu(hMenu, MF_STRING, IDM_CLOSE, LoadLocalizedString(IDS_MENU_CLOSE));
@@ -396,6 +398,17 @@ SetTrayIcon(conn_state_t state)
             TCHAR *assigned_ip = LoadLocalizedString(IDS_TIP_ASSIGNED_IP, o.conn[config].ip);
             _tcsncat(msg, assigned_ip, _countof(msg) - _tcslen(msg) - 1);
         }
+
+        /* Append the average throughput over the short window, the tip is
+         * limited to 128 characters */
+        double rx_rate, tx_rate;
+        if (GetByteCountRate(&o.conn[config].bytecount, BYTECOUNT_RATE_SHORT, &rx_rate, &tx_rate)) {
+            WCHAR rx_str[32], tx_str[32];
+            FormatByteRate(rx_rate, rx_str, _countof(rx_str));
+            FormatByteRate(tx_rate, tx_str, _countof(tx_str));
+            _tcsncat(msg, LoadLocalizedString(IDS_TIP_BYTECOUNT, rx_str, tx_str),
+                     _countof(msg) - _tcslen(msg) - 1);
+        }
     }
 
     icon_id = ID_ICO_CONNECTING;
@@ -410,7 +423,8 @@ SetTrayIcon(conn_state_t state)
     ni.hIcon = LoadLocalizedSmallIcon(icon_id);
     ni.uFlags = NIF_MESSAGE | NIF_TIP | NIF_ICON;
     ni.uCallbackMessage = WM_NOTIFYICONTRAY;
-    _tcsncpy(ni.szTip, msg, _countof(ni.szTip));
+    _tcsncpy(ni.szTip, msg, _countof(ni.szTip) - 1);
+    ni.szTip[_countof(ni.szTip) - 1] = _T('\0');
 
     Shell_NotifyIcon(NIM_MODIFY, &ni);
 }
@@ -486,12 +500,7 @@ SetMenuStatus(connection_t *c, conn_state_t state)
     }
     else
     {
-        int i;
-        for (i = 0; i < o.num_configs; ++i)
-        {
-            if (c == &o.conn[i])
-                break;
-        }
+        int i = c - o.conn;
 
         BOOL checked = (state == connected || state == disconnecting);
         CheckMenuItem(hMenu, i, MF_BYPOSITION | (checked ? MF_CHECKED : MF_UNCHECKED));
@@ -25,8 +25,10 @@
 
 #include <windows.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <shellapi.h>
 #include <objbase.h>
+#include <commctrl.h>
 
 #include "tray.h"
 #include "openvpn.h"
@@ -34,9 +36,495 @@
 #include "options.h"
 #include "openvpn-gui-res.h"
 #include "localization.h"
+#include "log_model.h"
+#include "log_index.h"
 
 extern options_t o;
 
+#define WM_LOGVIEW_INDEX (WM_APP + 20)
+
+#define LOG_FLAG_ALL (LOG_FLAG_INFO|LOG_FLAG_FATAL|LOG_FLAG_NONFATAL|LOG_FLAG_WARN|LOG_FLAG_DEBUG|LOG_FLAG_GUI)
+
+/* A log file shown in the built-in viewer */
+typedef struct log_viewer {
+    struct log_viewer *next;
+    HWND hwnd;
+    WCHAR path[MAX_PATH];
+    WCHAR config_name[MAX_PATH];
+    log_index_t index;
+    BYTE filter;            /* LOG_FLAG_* of the lines shown */
+    size_t *rows;           /* line shown in each row if filtered */
+    size_t nrows;
+    size_t rows_size;
+    size_t lines;           /* # of indexed lines checked against filter */
+    unsigned int resets;    /* # of truncations of the file seen */
+} log_viewer_t;
+
+static log_viewer_t *viewers;
+static SRWLOCK viewers_lock = SRWLOCK_INIT;
+
+static const struct {
+    UINT id;
+    BYTE flags;
+} filter_buttons[] = {
+    { ID_CHK_LOGVIEW_INFO, LOG_FLAG_INFO|LOG_FLAG_GUI },
+    { ID_CHK_LOGVIEW_WARN, LOG_FLAG_WARN },
+    { ID_CHK_LOGVIEW_NONFATAL, LOG_FLAG_NONFATAL },
+    { ID_CHK_LOGVIEW_FATAL, LOG_FLAG_FATAL },
+    { ID_CHK_LOGVIEW_DEBUG, LOG_FLAG_DEBUG }
+};
+
+/*
+ * Line number shown in row n of the viewer
+ */
+static size_t
+RowLine(log_viewer_t *v, size_t n)
+{
+    return (v->filter == LOG_FLAG_ALL ? n : v->rows[n]);
+}
+
+/*
+ * Show the lines indexed since the last update. With refilter all
+ * lines are checked against the filter again.
+ */
+static void
+UpdateLogViewer(log_viewer_t *v, BOOL refilter)
+{
+    HWND list = GetDlgItem(v->hwnd, ID_LST_LOGVIEW);
+    DWORD flags = LVSICF_NOINVALIDATEALL|LVSICF_NOSCROLL;
+    unsigned int resets;
+    size_t lines, rows;
+    WCHAR status[100];
+
+    lines = LogIndexCount(&v->index, &resets);
+    if (resets != v->resets || refilter)
+    {
+        v->resets = resets;
+        v->lines = 0;
+        v->nrows = 0;
+        flags = 0;
+    }
+
+    if (v->filter == LOG_FLAG_ALL)
+    {
+        v->lines = lines;
+        rows = lines;
+    }
+    else
+    {
+        while (v->lines < lines)
+        {
+            if (v->nrows == v->rows_size)
+            {
+                size_t size = max(v->rows_size * 2, (size_t) 4096);
+                size_t *p = realloc(v->rows, size * sizeof(*p));
+                if (p == NULL)
+                    break;
+                v->rows = p;
+                v->rows_size = size;
+            }
+            v->nrows += LogIndexFilter(&v->index, v->filter, v->lines, v->rows + v->nrows,
+                                       v->rows_size - v->nrows, &v->lines);
+        }
+        rows = v->nrows;
+        lines = max(lines, v->lines);
+    }
+
+    ListView_SetItemCountEx(list, (int) rows, flags);
+    if (rows && IsDlgButtonChecked(v->hwnd, ID_CHK_LOGVIEW_FOLLOW) == BST_CHECKED)
+        ListView_EnsureVisible(list, (int) rows - 1, FALSE);
+
+    if (v->filter == LOG_FLAG_ALL)
+        LoadLocalizedStringBuf(status, _countof(status), IDS_NFO_LOGVIEW_LINES, lines);
+    else
+        LoadLocalizedStringBuf(status, _countof(status), IDS_NFO_LOGVIEW_FILTERED, rows, lines);
+    SetDlgItemText(v->hwnd, ID_TXT_LOGVIEW_STATUS, status);
+}
+
+/*
+ * First row showing line n or a later line
+ */
+static int
+FirstLogRow(log_viewer_t *v, size_t n, int rows)
+{
+    int lo = 0, hi = rows - 1;
+
+    if (v->filter == LOG_FLAG_ALL)
+        return (int) min(n, (size_t) rows - 1);
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (v->rows[mid] < n)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void
+SelectLogRow(log_viewer_t *v, int row)
+{
+    HWND list = GetDlgItem(v->hwnd, ID_LST_LOGVIEW);
+
+    CheckDlgButton(v->hwnd, ID_CHK_LOGVIEW_FOLLOW, BST_UNCHECKED);
+    ListView_SetItemState(list, -1, 0, LVIS_SELECTED);
+    ListView_SetItemState(list, row, LVIS_SELECTED|LVIS_FOCUSED, LVIS_SELECTED|LVIS_FOCUSED);
+    ListView_EnsureVisible(list, row, FALSE);
+}
+
+/*
+ * Select the row of the line number entered, or the next shown line
+ */
+static void
+GotoLogLine(log_viewer_t *v)
+{
+    HWND list = GetDlgItem(v->hwnd, ID_LST_LOGVIEW);
+    int rows = ListView_GetItemCount(list);
+    BOOL ok;
+    UINT line;
+
+    line = GetDlgItemInt(v->hwnd, ID_EDT_LOGVIEW_LINE, &ok, FALSE);
+    if (!ok || line == 0 || rows == 0)
+        return;
+
+    SelectLogRow(v, FirstLogRow(v, line - 1, rows));
+    SetFocus(list);
+}
+
+/*
+ * Select the next shown line containing the text of the find box,
+ * continuing from the top after the last line
+ */
+static void
+FindLogLine(log_viewer_t *v)
+{
+    HWND list = GetDlgItem(v->hwnd, ID_LST_LOGVIEW);
+    int rows = ListView_GetItemCount(list);
+    int sel = ListView_GetNextItem(list, -1, LVNI_FOCUSED);
+    WCHAR query[256];
+    WCHAR status[300];
+    size_t from, line;
+    BOOL wrapped = FALSE;
+    int row;
+
+    GetDlgItemText(v->hwnd, ID_EDT_LOGVIEW_FIND, query, _countof(query));
+    if (query[0] == L'\0' || rows == 0)
+        return;
+
+    from = (sel >= 0 && sel < rows) ? RowLine(v, sel) + 1 : 0;
+    for (;;)
+    {
+        if (!LogIndexFind(&v->index, query, from, &line))
+        {
+            if (wrapped || from == 0)
+            {
+                LoadLocalizedStringBuf(status, _countof(status), IDS_NFO_LOG_NOT_FOUND, query);
+                SetDlgItemText(v->hwnd, ID_TXT_LOGVIEW_STATUS, status);
+                MessageBeep(MB_OK);
+                return;
+            }
+            wrapped = TRUE;
+            from = 0;
+            continue;
+        }
+
+        /* skip lines hidden by the filter or not shown yet */
+        row = FirstLogRow(v, line, rows);
+        if (RowLine(v, row) == line)
+            break;
+        from = line + 1;
+    }
+
+    SelectLogRow(v, row);
+}
+
+/*
+ * Handle notifications of the line list
+ */
+static LRESULT
+OnLogViewerNotify(log_viewer_t *v, NMHDR *hdr)
+{
+    switch (hdr->code)
+    {
+    case LVN_GETDISPINFO:
+    {
+        LVITEM *item = &((NMLVDISPINFO *) hdr)->item;
+        size_t line = RowLine(v, item->iItem);
+
+        if (!(item->mask & LVIF_TEXT))
+            break;
+        if (item->iSubItem == 0)
+            _snwprintf(item->pszText, item->cchTextMax, L"%Iu", line + 1);
+        else
+            LogIndexLine(&v->index, line, item->pszText, item->cchTextMax, NULL);
+        if (item->cchTextMax > 0)
+            item->pszText[item->cchTextMax - 1] = L'\0';
+        break;
+    }
+
+    case NM_CUSTOMDRAW:
+    {
+        NMLVCUSTOMDRAW *cd = (NMLVCUSTOMDRAW *) hdr;
+        BYTE flags;
+
+        if (cd->nmcd.dwDrawStage == CDDS_PREPAINT)
+            return CDRF_NOTIFYITEMDRAW;
+        if (cd->nmcd.dwDrawStage != CDDS_ITEMPREPAINT
+            || !LogIndexLine(&v->index, RowLine(v, cd->nmcd.dwItemSpec), NULL, 0, &flags))
+            break;
+
+        if (flags & (LOG_FLAG_FATAL|LOG_FLAG_NONFATAL))
+            cd->clrText = o.clr_error;
+        else if (flags & LOG_FLAG_WARN)
+            cd->clrText = o.clr_warning;
+        else
+            break;
+        return CDRF_NEWFONT;
+    }
+    }
+    return CDRF_DODEFAULT;
+}
+
+static void
+RenderLogViewer(HWND hwndDlg, int w, int h)
+{
+    RECT top = { 0, 0, 0, 37 };
+
+    /* the controls above the list are placed by the dialog template */
+    MapDialogRect(hwndDlg, &top);
+    MoveWindow(GetDlgItem(hwndDlg, ID_LST_LOGVIEW), DPI_SCALE(5), top.bottom,
+               w - DPI_SCALE(10), h - top.bottom - DPI_SCALE(25), TRUE);
+    MoveWindow(GetDlgItem(hwndDlg, ID_TXT_LOGVIEW_STATUS), DPI_SCALE(5), h - DPI_SCALE(20),
+               w - DPI_SCALE(10), DPI_SCALE(15), TRUE);
+}
+
+static INT_PTR CALLBACK
+LogViewerDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    log_viewer_t *v;
+    WCHAR title[MAX_PATH + 64];
+    size_t i;
+
+    switch (msg)
+    {
+    case WM_INITDIALOG:
+    {
+        v = (log_viewer_t *) lParam;
+        SetProp(hwndDlg, cfgProp, (HANDLE) v);
+
+        HWND list = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, NULL,
+            WS_CHILD|WS_VISIBLE|WS_TABSTOP|LVS_REPORT|LVS_OWNERDATA|
+            LVS_NOCOLUMNHEADER|LVS_SHOWSELALWAYS,
+            5, 30, 390, 200, hwndDlg, (HMENU) ID_LST_LOGVIEW, o.hInstance, NULL);
+        if (!list)
+        {
+            EndDialog(hwndDlg, FALSE);
+            return TRUE;
+        }
+        ListView_SetExtendedListViewStyle(list, LVS_EX_FULLROWSELECT|LVS_EX_DOUBLEBUFFER);
+        LVCOLUMN col = {
+            .mask = LVCF_WIDTH,
+            .cx = DPI_SCALE(60)
+        };
+        ListView_InsertColumn(list, 0, &col);
+        col.cx = DPI_SCALE(2000);
+        ListView_InsertColumn(list, 1, &col);
+        SendMessage(list, WM_SETFONT, SendMessage(hwndDlg, WM_GETFONT, 0, 0), FALSE);
+
+        LoadLocalizedStringBuf(title, _countof(title), IDS_NFO_LOGVIEW_TITLE, v->config_name);
+        SetWindowText(hwndDlg, title);
+        SendMessage(hwndDlg, WM_SETICON, (WPARAM) ICON_SMALL, (LPARAM) LoadLocalizedSmallIcon(ID_ICO_APP));
+        SendMessage(hwndDlg, WM_SETICON, (WPARAM) ICON_BIG, (LPARAM) LoadLocalizedIcon(ID_ICO_APP));
+
+        CheckDlgButton(hwndDlg, ID_CHK_LOGVIEW_FOLLOW, BST_CHECKED);
+        for (i = 0; i < _countof(filter_buttons); ++i)
+            CheckDlgButton(hwndDlg, filter_buttons[i].id, BST_CHECKED);
+        v->filter = LOG_FLAG_ALL;
+
+        AcquireSRWLockExclusive(&viewers_lock);
+        v->hwnd = hwndDlg;
+        ReleaseSRWLockExclusive(&viewers_lock);
+
+        if (!OpenLogIndex(&v->index, v->path, hwndDlg, WM_LOGVIEW_INDEX))
+        {
+            ShowLocalizedMsg(IDS_ERR_LOGVIEW_OPEN, v->path);
+            EndDialog(hwndDlg, FALSE);
+            return TRUE;
+        }
+
+        SetFocus(list);
+        return FALSE;
+    }
+
+    case WM_SIZE:
+        RenderLogViewer(hwndDlg, LOWORD(lParam), HIWORD(lParam));
+        InvalidateRect(hwndDlg, NULL, TRUE);
+        return TRUE;
+
+    case WM_LOGVIEW_INDEX:
+        v = (log_viewer_t *) GetProp(hwndDlg, cfgProp);
+        UpdateLogViewer(v, FALSE);
+        return TRUE;
+
+    case WM_NOTIFY:
+        v = (log_viewer_t *) GetProp(hwndDlg, cfgProp);
+        if (((NMHDR *) lParam)->idFrom == ID_LST_LOGVIEW)
+        {
+            SetWindowLongPtr(hwndDlg, DWLP_MSGRESULT, OnLogViewerNotify(v, (NMHDR *) lParam));
+            return TRUE;
+        }
+        break;
+
+    case WM_COMMAND:
+        v = (log_viewer_t *) GetProp(hwndDlg, cfgProp);
+        switch (LOWORD(wParam))
+        {
+        case ID_CHK_LOGVIEW_FOLLOW:
+            UpdateLogViewer(v, FALSE);
+            return TRUE;
+
+        case ID_CHK_LOGVIEW_INFO:
+        case ID_CHK_LOGVIEW_WARN:
+        case ID_CHK_LOGVIEW_NONFATAL:
+        case ID_CHK_LOGVIEW_FATAL:
+        case ID_CHK_LOGVIEW_DEBUG:
+            v->filter = 0;
+            for (i = 0; i < _countof(filter_buttons); ++i)
+            {
+                if (IsDlgButtonChecked(hwndDlg, filter_buttons[i].id) == BST_CHECKED)
+                    v->filter |= filter_buttons[i].flags;
+            }
+            UpdateLogViewer(v, TRUE);
+            return TRUE;
+
+        case IDOK:
+            if (GetFocus() == GetDlgItem(hwndDlg, ID_EDT_LOGVIEW_FIND))
+                FindLogLine(v);
+            else
+                GotoLogLine(v);
+            return TRUE;
+
+        case ID_BTN_LOGVIEW_GOTO:
+            GotoLogLine(v);
+            return TRUE;
+
+        case ID_BTN_LOGVIEW_FIND:
+            FindLogLine(v);
+            return TRUE;
+
+        case IDCANCEL:
+            SendMessage(hwndDlg, WM_CLOSE, 0, 0);
+            return TRUE;
+        }
+        break;
+
+    case WM_CLOSE:
+        /* Unmap the file right away, OpenVPN may be waiting to truncate it */
+        v = (log_viewer_t *) GetProp(hwndDlg, cfgProp);
+        CloseLogIndex(&v->index);
+        EndDialog(hwndDlg, TRUE);
+        return TRUE;
+
+    case WM_DESTROY:
+        v = (log_viewer_t *) GetProp(hwndDlg, cfgProp);
+        CloseLogIndex(&v->index);
+        RemoveProp(hwndDlg, cfgProp);
+        break;
+    }
+    return FALSE;
+}
+
+/*
+ * ThreadProc of a log viewer window
+ */
+static DWORD WINAPI
+ThreadLogViewer(void *p)
+{
+    log_viewer_t *v = p;
+    log_viewer_t **pv;
+
+    LocalizedDialogBoxParam(ID_DLG_LOGVIEW, LogViewerDialogFunc, (LPARAM) v);
+
+    AcquireSRWLockExclusive(&viewers_lock);
+    for (pv = &viewers; *pv; pv = &(*pv)->next)
+    {
+        if (*pv == v)
+        {
+            *pv = v->next;
+            break;
+        }
+    }
+    ReleaseSRWLockExclusive(&viewers_lock);
+
+    free(v->rows);
+    free(v);
+    return 0;
+}
+
+/*
+ * Show a log file in the built-in viewer, or bring its viewer to the front
+ */
+static void
+OpenLogViewer(const WCHAR *path, const WCHAR *config_name)
+{
+    log_viewer_t *v;
+    HANDLE thread;
+    HWND hwnd = NULL;
+
+    AcquireSRWLockExclusive(&viewers_lock);
+    for (v = viewers; v; v = v->next)
+    {
+        if (_wcsicmp(v->path, path) == 0)
+        {
+            hwnd = v->hwnd;
+            break;
+        }
+    }
+    if (v == NULL && (v = calloc(1, sizeof(*v))) != NULL)
+    {
+        wcsncpy(v->path, path, _countof(v->path) - 1);
+        wcsncpy(v->config_name, config_name, _countof(v->config_name) - 1);
+        thread = CreateThread(NULL, 0, ThreadLogViewer, v, 0, NULL);
+        if (thread)
+        {
+            v->next = viewers;
+            viewers = v;
+            CloseHandle(thread);
+        }
+        else
+        {
+            free(v);
+        }
+    }
+    ReleaseSRWLockExclusive(&viewers_lock);
+
+    if (hwnd)
+    {
+        ShowWindow(hwnd, SW_RESTORE);
+        SetForegroundWindow(hwnd);
+    }
+}
+
+/*
+ * Close the built-in viewer of a log file, if any. The file is no
+ * longer mapped when this returns.
+ */
+void
+CloseLogViewer(const WCHAR *path)
+{
+    log_viewer_t *v;
+
+    AcquireSRWLockShared(&viewers_lock);
+    for (v = viewers; v; v = v->next)
+    {
+        if (v->hwnd && _wcsicmp(v->path, path) == 0)
+            SendMessage(v->hwnd, WM_CLOSE, 0, 0);
+    }
+    ReleaseSRWLockShared(&viewers_lock);
+}
+
 void ViewLog(int config)
 {
   TCHAR filename[2*MAX_PATH];
@@ -52,6 +540,12 @@ void ViewLog(int config)
   CLEAR (sa);
   CLEAR (sd);
 
+  if (o.internal_log_viewer)
+    {
+      OpenLogViewer(o.conn[config].log_path, o.conn[config].config_name);
+      return;
+    }
+
   /* Try first using file association */
   CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE); /* Safe to init COM multiple times */
   status = ShellExecuteW (o.hWnd, L"open", o.conn[config].log_path, NULL, o.log_dir, SW_SHOWNORMAL);
@@ -20,4 +20,5 @@
  */
 
 void ViewLog(int config);
+void CloseLogViewer(const WCHAR *path);
 void EditConfig(int config);